@@ -0,0 +1,164 @@
+/* arena.c
+ * bump allocator for tshlab
+ */
+
+#include <errno.h>
+#include <stdalign.h>
+#include <sys/mman.h>
+#include "arena.h"
+
+#define ALIGN   alignof(max_align_t)
+
+#define TOP(last, used) ((uint64_t) (last) << 32 | (used))
+#define TOP_USED(top)   ((size_t) ((top) & 0xffffffff))
+#define TOP_LAST(top)   ((size_t) ((top) >> 32))
+
+/*
+ * note_peak - Remember how much was used before used goes down. A
+ * handler racing with the main program may lose an update, which only
+ * keeps some pages mapped after the next reset.
+ */
+static void note_peak(struct arena *a, size_t used)
+{
+    if (used > a->peak)
+    {
+        a->peak = used;
+    }
+}
+
+/* arena_init - Reserve the address space of an arena */
+bool arena_init(struct arena *a, size_t limit, int flags)
+{
+    void *p;
+
+    if ((flags & ARENA_SIGSAFE) && limit > UINT32_MAX)
+    {
+        errno = EINVAL;
+        return false;
+    }
+    p = mmap(NULL, limit, PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (p == MAP_FAILED)
+    {
+        return false;
+    }
+    a->base = p;
+    a->limit = limit;
+    a->used = 0;
+    a->last = 0;
+    a->peak = 0;
+    a->sigsafe = (flags & ARENA_SIGSAFE) != 0;
+    atomic_init(&a->top, 0);
+    return true;
+}
+
+/* arena_alloc - Take size bytes from the arena */
+void *arena_alloc(struct arena *a, size_t size)
+{
+    uint64_t top;
+    size_t off;
+
+    if (!a->sigsafe)
+    {
+        off = (a->used + ALIGN - 1) & ~(ALIGN - 1);
+        if (off > a->limit || size > a->limit - off)
+        {
+            return NULL;
+        }
+        a->last = off;
+        a->used = off + size;
+        return a->base + off;
+    }
+
+    top = atomic_load_explicit(&a->top, memory_order_relaxed);
+    do
+    {
+        off = (TOP_USED(top) + ALIGN - 1) & ~(ALIGN - 1);
+        if (off > a->limit || size > a->limit - off)
+        {
+            return NULL;
+        }
+    } while (!atomic_compare_exchange_weak_explicit(&a->top, &top,
+                                                    TOP(off, off + size),
+                                                    memory_order_relaxed,
+                                                    memory_order_relaxed));
+    return a->base + off;
+}
+
+/* arena_resize - Grow or shrink the newest allocation in place */
+bool arena_resize(struct arena *a, void *p, size_t size)
+{
+    size_t off = (char *) p - a->base;
+    uint64_t top;
+
+    if (!a->sigsafe)
+    {
+        if (off != a->last || size > a->limit - off)
+        {
+            return false;
+        }
+        note_peak(a, a->used);
+        a->used = off + size;
+        return true;
+    }
+
+    top = atomic_load_explicit(&a->top, memory_order_relaxed);
+    do
+    {
+        if (off != TOP_LAST(top) || size > a->limit - off)
+        {
+            return false;
+        }
+    } while (!atomic_compare_exchange_weak_explicit(&a->top, &top,
+                                                    TOP(off, off + size),
+                                                    memory_order_relaxed,
+                                                    memory_order_relaxed));
+    note_peak(a, TOP_USED(top));
+    return true;
+}
+
+/* arena_mark - Note the current point of the arena */
+struct arena_mark arena_mark(struct arena *a)
+{
+    struct arena_mark mark;
+    uint64_t top;
+
+    if (!a->sigsafe)
+    {
+        mark.used = a->used;
+        mark.last = a->last;
+        return mark;
+    }
+    top = atomic_load_explicit(&a->top, memory_order_relaxed);
+    mark.used = TOP_USED(top);
+    mark.last = TOP_LAST(top);
+    return mark;
+}
+
+/* arena_rewind - Free everything allocated since the mark */
+void arena_rewind(struct arena *a, struct arena_mark mark)
+{
+    if (!a->sigsafe)
+    {
+        note_peak(a, a->used);
+        a->used = mark.used;
+        a->last = mark.last;
+        return;
+    }
+    note_peak(a, TOP_USED(atomic_exchange_explicit(&a->top,
+                                                   TOP(mark.last, mark.used),
+                                                   memory_order_relaxed)));
+}
+
+/* arena_reset - Free everything, returning the memory of a big command */
+void arena_reset(struct arena *a)
+{
+    struct arena_mark start = { 0, 0 };
+
+    arena_rewind(a, start);
+    if (a->peak > ARENA_KEEP)
+    {
+        madvise(a->base + ARENA_KEEP, a->peak - ARENA_KEEP, MADV_DONTNEED);
+    }
+    a->peak = 0;
+}
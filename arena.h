@@ -0,0 +1,90 @@
+/*
+ * arena.h: bump allocator for tshlab
+ *
+ * arena.h defines the arena that holds everything tsh builds for one
+ * command: the line as read, the copy parseline cuts into words, and
+ * the argv array. Allocation only moves a pointer, and the whole arena
+ * is released in O(1) by arena_reset once the command has been
+ * evaluated. Code that needs memory for part of a command only takes a
+ * mark first, and rewinds to it when done.
+ *
+ * The arena reserves its full size of address space up front, so it
+ * never moves and the newest allocation can grow in place; the kernel
+ * only supplies memory for the pages actually touched. After an
+ * unusually large command the pages beyond ARENA_KEEP are handed back.
+ * No malloc is involved.
+ *
+ * An arena made with ARENA_SIGSAFE may also be used by signal handlers.
+ * Its allocation pointer and newest allocation are kept in one word
+ * that is only changed by compare-and-swap, so an allocation that a
+ * handler interrupts is retried rather than handed out twice, and a
+ * resize fails if a handler allocated after the block being resized.
+ * Such an arena must be smaller than 4 GiB. A handler may not reset an
+ * arena, and should rewind to a mark it took itself.
+ */
+
+#ifndef __ARENA_H__
+#define __ARENA_H__
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define ARENA_KEEP      (256 * 1024)    // bytes kept mapped across resets
+
+#define ARENA_SIGSAFE   0x1             // arena_init: usable in handlers
+
+struct arena                    // A bump allocator
+{
+    char *base;                 // Start of the reserved space
+    size_t limit;               // Size of the reserved space
+    size_t used;                // Bytes allocated
+    size_t last;                // Offset of the newest allocation
+    size_t peak;                // Most bytes used since the last reset
+    bool sigsafe;               // Made with ARENA_SIGSAFE
+    _Atomic uint64_t top;       // last << 32 | used, if sigsafe
+};
+
+struct arena_mark               // A point to rewind an arena to
+{
+    size_t used;                // Bytes allocated at the mark
+    size_t last;                // Newest allocation at the mark
+};
+
+/*
+ * arena_init reserves limit bytes of address space for a. flags is 0
+ * or ARENA_SIGSAFE. Returns false and sets errno on failure.
+ */
+bool arena_init(struct arena *a, size_t limit, int flags);
+
+/*
+ * arena_alloc returns size bytes, aligned for any type, or NULL if the
+ * arena does not have them.
+ */
+void *arena_alloc(struct arena *a, size_t size);
+
+/*
+ * arena_resize changes the size of p, which must be the newest
+ * allocation, in place. Returns false, leaving p as it was, if the
+ * arena does not have the space.
+ */
+bool arena_resize(struct arena *a, void *p, size_t size);
+
+/*
+ * arena_mark returns the current point of a, for arena_rewind.
+ */
+struct arena_mark arena_mark(struct arena *a);
+
+/*
+ * arena_rewind frees everything allocated from a since mark was taken,
+ * in O(1). Marks taken after mark are no longer valid.
+ */
+void arena_rewind(struct arena *a, struct arena_mark mark);
+
+/*
+ * arena_reset frees everything allocated from a.
+ */
+void arena_reset(struct arena *a);
+
+#endif
@@ -0,0 +1,151 @@
+/*
+ * benchparse.c - Shell lab tokenizer benchmark
+ *
+ * Measures the throughput of the command line tokenizer behind parseline
+ * with each of its scanning implementations, against the strspn/strcspn
+ * loop that parseline used before. The input is a set of command lines
+ * of a given length made of words, quoted strings, redirections and
+ * pipes.
+ *
+ * Usage: ./benchparse [-n iters] [-l line_len]
+ */
+
+#include <time.h>
+#include "csapp.h"
+#include "tokenize.h"
+
+#define NLINES 64               /* distinct lines, cycled through */
+
+static char lines[NLINES][MAXLINE];
+static size_t lens[NLINES];
+static struct tok_span spans[MAXLINE];
+
+/* Time in seconds from a monotonic clock */
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Fill buf with a command line of about len bytes */
+static size_t make_line(char *buf, size_t len)
+{
+    static const char *pieces[] = {
+	"/usr/bin/frobnicate", "--verbose", "-x", "a_rather_long_file_name.txt",
+	"'a quoted argument with spaces'", "\"double quoted\"", "<", "in",
+	"|", "grep", "-e", "pattern", ">", "out", "42", "\t",
+    };
+    size_t n = 0, k;
+    const char *p;
+
+    while (n < len) {
+	p = pieces[random() % (sizeof(pieces) / sizeof(pieces[0]))];
+	k = strlen(p);
+	if (n + k + 1 >= len)
+	    break;
+	memcpy(buf + n, p, k);
+	n += k;
+	buf[n++] = ' ';
+    }
+    buf[n] = '\0';
+    return n;
+}
+
+/* The strspn/strcspn loop of the old parseline, on a copy of the line */
+static int libc_tokenize(const char *line, size_t len)
+{
+    static char text[MAXLINE];
+    const char delims[] = " \t\r\n";
+    char *buf = text, *next, *endbuf = text + len;
+    int n = 0;
+
+    memcpy(text, line, len + 1);
+    while (buf < endbuf) {
+	buf += strspn(buf, delims);
+	if (buf >= endbuf)
+	    break;
+	if (*buf == '<' || *buf == '>' || *buf == '|') {
+	    buf++;
+	    n++;
+	    continue;
+	}
+	if (*buf == '\'' || *buf == '\"') {
+	    buf++;
+	    if ((next = strchr(buf, buf[-1])) == NULL)
+		break;
+	} else
+	    next = buf + strcspn(buf, delims);
+	*next = '\0';
+	n++;
+	buf = next + 1;
+    }
+    return n;
+}
+
+/* Time iters passes over the lines with impl, and print a result row */
+static void run(const char *impl, int iters, size_t total)
+{
+    double start, elapsed;
+    size_t pos, errpos;
+    long ntok = 0;
+    int i;
+
+    if (impl != NULL && !tokenize_setimpl(impl)) {
+	printf("%-8s %12s\n", impl, "unsupported");
+	return;
+    }
+    start = now();
+    for (i = 0; i < iters; i++) {
+	if (impl == NULL)
+	    ntok += libc_tokenize(lines[i % NLINES], lens[i % NLINES]);
+	else {
+	    pos = 0;
+	    ntok += tokenize(lines[i % NLINES], lens[i % NLINES], &pos, spans,
+			     MAXLINE, &errpos);
+	}
+    }
+    elapsed = now() - start;
+    printf("%-8s %12.1f %12.1f %12.1f\n", impl ? impl : "libc",
+	   elapsed * 1e9 / iters, total / elapsed / 1e6,
+	   (double) ntok / iters);
+}
+
+int main(int argc, char **argv)
+{
+    int c, i, iters = 1000000;
+    size_t len = 1000, total = 0;
+
+    while ((c = getopt(argc, argv, "n:l:")) != EOF) {
+	switch (c) {
+	case 'n':
+	    iters = atoi(optarg);
+	    break;
+	case 'l':
+	    len = atoi(optarg);
+	    break;
+	default:
+	    fprintf(stderr, "Usage: %s [-n iters] [-l line_len]\n", argv[0]);
+	    exit(1);
+	}
+    }
+    if (len < 2 || len >= MAXLINE) {
+	fprintf(stderr, "line_len must be between 2 and %d\n", MAXLINE - 1);
+	exit(1);
+    }
+
+    srandom(1);
+    for (i = 0; i < NLINES; i++)
+	lens[i] = make_line(lines[i], len);
+    for (i = 0; i < iters; i++)
+	total += lens[i % NLINES];
+
+    printf("%d lines of about %zu bytes\n", iters, len);
+    printf("%-8s %12s %12s %12s\n", "impl", "ns/line", "MB/s", "tokens");
+    run(NULL, iters, total);
+    run("scalar", iters, total);
+    run("sse2", iters, total);
+    run("avx2", iters, total);
+    exit(0);
+}
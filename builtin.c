@@ -0,0 +1,22 @@
+/* builtin.c
+ * builtin command registry for tshlab
+ */
+
+#include <string.h>
+#include "tsh_helper.h"
+#include "builtin.h"
+#include "builtin_table.h"
+
+/* builtin_lookup - Find a builtin by name */
+const struct builtin *builtin_lookup(const char *name)
+{
+    const struct builtin *b;
+
+    b = &builtin_table[builtin_hash(name, BUILTIN_SEED) &
+                       (BUILTIN_SLOTS - 1)];
+    if (b->name != NULL && strcmp(b->name, name) == 0)
+    {
+        return b;
+    }
+    return NULL;
+}
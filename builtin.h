@@ -0,0 +1,62 @@
+/*
+ * builtin.h: builtin command registry for tshlab
+ *
+ * builtin.h defines the table of tsh's builtin commands. The table is
+ * not written by hand: mkbuiltins reads builtins.def at build time,
+ * searches for a hash seed under which every builtin name lands in its
+ * own slot, and writes the table to builtin_table.h. Looking up a
+ * command name then costs one hash and one string compare, however
+ * many builtins there are.
+ *
+ * To add a builtin, add a line to builtins.def and define its handler
+ * (declared in tsh_helper.h); nothing else needs to change.
+ */
+
+#ifndef __BUILTIN_H__
+#define __BUILTIN_H__
+
+#include <stdint.h>
+
+struct cmdline_tokens;
+
+// Builtin flags
+#define BUILTIN_REDIR       0x1 // Accepts < and > (applied to the
+                                // shell's stdin and stdout while the
+                                // handler runs); an error otherwise
+#define BUILTIN_ASYNC_SAFE  0x2 // Handler makes only async-signal-safe
+                                // calls
+#define BUILTIN_UTILITY     0x4 // Stands in for an external utility: only
+                                // for a foreground command, and the
+                                // utility runs if stdcmd_wantsreal says so
+#define BUILTIN_OWNREDIR    0x8 // Accepts < and >, but the handler
+                                // applies them itself
+
+struct builtin                  // A builtin command
+{
+    const char *name;           // Command name, NULL for an empty slot
+    void (*handler)(const struct cmdline_tokens *token);
+    unsigned flags;             // BUILTIN_* flags
+};
+
+/*
+ * builtin_hash hashes a command name (FNV-1a, started from seed). Shared
+ * by mkbuiltins and builtin_lookup so that both agree on the slots.
+ */
+static inline uint32_t builtin_hash(const char *name, uint32_t seed)
+{
+    uint32_t h = 2166136261u ^ seed;
+
+    while (*name != '\0')
+    {
+        h = (h ^ (unsigned char) *name++) * 16777619u;
+    }
+    return h ^ (h >> 15);
+}
+
+/*
+ * builtin_lookup returns the builtin called name, or NULL if name is not
+ * a builtin.
+ */
+const struct builtin *builtin_lookup(const char *name);
+
+#endif
@@ -0,0 +1,113 @@
+/*
+ * catbench.c - Shell lab redirection throughput benchmark
+ *
+ * Measures how fast tsh moves a file through its < and > redirections
+ * with the cat builtin, which has the kernel copy the bytes, against
+ * the external mycat, which copies them a byte at a time through
+ * stdio. Each run is a "tsh -c" of the command, so both pay for one
+ * shell start (tsh execs mycat in place of itself). Files double in
+ * size from 1 MB, and are copied both to /dev/null and to a file next
+ * to them.
+ *
+ * Usage: ./catbench [-n runs] [-m max_mb] [-d dir]
+ */
+
+#include <time.h>
+#include "csapp.h"
+
+/* Time in seconds from a monotonic clock */
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Make the file at path hold mb megabytes of text */
+static void make_file(const char *path, size_t mb)
+{
+    static char chunk[1 << 20];
+    size_t i;
+    int fd;
+
+    for (i = 0; i < sizeof(chunk); i++)
+	chunk[i] = i % 64 == 63 ? '\n' : 'a' + i % 26;
+    fd = Open(path, O_WRONLY | O_CREAT | O_TRUNC, DEF_MODE);
+    for (i = 0; i < mb; i++)
+	Rio_writen(fd, chunk, sizeof(chunk));
+    Close(fd);
+}
+
+/* Best time of runs runs of "tsh -c cmd" */
+static double best_time(const char *cmd, int runs)
+{
+    char *args[] = { "./tsh", "-l", "vfork", "-c", (char *) cmd, NULL };
+    double start, t, best = 0;
+    int i, status;
+    pid_t pid;
+
+    for (i = 0; i < runs; i++) {
+	start = now();
+	if ((pid = Fork()) == 0)
+	    Execve(args[0], args, environ);
+	Waitpid(pid, &status, 0);
+	t = now() - start;
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+	    app_error("command failed");
+	if (i == 0 || t < best)
+	    best = t;
+    }
+    return best;
+}
+
+int main(int argc, char **argv)
+{
+    char in[MAXLINE], out[MAXLINE], cmd[3 * MAXLINE];
+    const char *dir = "/tmp", *target;
+    double cat_time, mycat_time;
+    size_t mb, max_mb = 256;
+    int c, runs = 3, k;
+
+    while ((c = getopt(argc, argv, "n:m:d:")) != EOF) {
+	switch (c) {
+	case 'n':
+	    runs = atoi(optarg);
+	    break;
+	case 'm':
+	    max_mb = atoi(optarg);
+	    break;
+	case 'd':
+	    dir = optarg;
+	    break;
+	default:
+	    fprintf(stderr, "Usage: %s [-n runs] [-m max_mb] [-d dir]\n",
+		    argv[0]);
+	    exit(1);
+	}
+    }
+    if (runs < 1 || max_mb < 1) {
+	fprintf(stderr, "runs and max_mb must be at least 1\n");
+	exit(1);
+    }
+    snprintf(in, sizeof(in), "%s/catbench.in", dir);
+    snprintf(out, sizeof(out), "%s/catbench.out", dir);
+
+    printf("best of %d runs, MB/s\n", runs);
+    printf("%8s %-10s %12s %12s\n", "size MB", "to", "cat", "mycat");
+    for (mb = 1; mb <= max_mb; mb *= 2) {
+	make_file(in, mb);
+	for (k = 0; k < 2; k++) {
+	    target = k == 0 ? "/dev/null" : out;
+	    snprintf(cmd, sizeof(cmd), "cat < %s > %s", in, target);
+	    cat_time = best_time(cmd, runs);
+	    snprintf(cmd, sizeof(cmd), "./mycat < %s > %s", in, target);
+	    mycat_time = best_time(cmd, runs);
+	    printf("%8zu %-10s %12.1f %12.1f\n", mb, k == 0 ? "/dev/null" :
+		   "file", mb / cat_time, mb / mycat_time);
+	}
+    }
+    unlink(in);
+    unlink(out);
+    exit(0);
+}
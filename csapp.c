@@ -20,6 +20,7 @@
  */
 /* $begin csapp.c */
 #include "csapp.h"
+#include <limits.h>
 
 /************************** 
  * Error-handling functions
@@ -256,6 +257,27 @@ static size_t sio_strlen(char s[])
         ++i;
     return i;
 }
+
+/* sio_utoa - Convert unsigned long to base b string, return its length */
+static size_t sio_utoa(unsigned long v, char s[], int b)
+{
+    int c;
+    size_t i = 0;
+
+    do {
+        s[i++] = ((c = (v % b)) < 10)  ?  c + '0' : c - 10 + 'a';
+    } while ((v /= b) > 0);
+    s[i] = '\0';
+    sio_reverse(s);
+    return i;
+}
+
+/* sio_putc - Store c at buf[*n] if it fits in size - 1 bytes */
+static void sio_putc(char *buf, size_t size, size_t *n, char c)
+{
+    if (*n + 1 < size)
+        buf[(*n)++] = c;
+}
 /* $end sioprivate */
 
 /* Public Sio functions */
@@ -279,6 +301,132 @@ void sio_error(char s[]) /* Put error message and exit */
     sio_puts(s);
     _exit(1);                                      //line:csapp:sioexit
 }
+
+/*
+ * sio_vsnprintf - Format into buf, as vsnprintf, supporting the
+ * conversions %d, %i, %u, %x, %s, %c and %% with the l and z length
+ * modifiers, a field width (or *) and the - and 0 flags. Stores at most
+ * size - 1 characters and a '\0', and returns the number stored.
+ */
+ssize_t sio_vsnprintf(char *buf, size_t size, const char *fmt, va_list ap)
+{
+    char num[sizeof(long) * 8 + 2];
+    const char *s;
+    size_t n = 0, len, i;
+    int width, left, zero, islong;
+    unsigned long u;
+    long v;
+
+    for (; *fmt != '\0'; fmt++) {
+        if (*fmt != '%') {
+            sio_putc(buf, size, &n, *fmt);
+            continue;
+        }
+
+        /* Flags, width and length */
+        left = zero = 0;
+        for (fmt++; *fmt == '-' || *fmt == '0'; fmt++) {
+            if (*fmt == '-')
+                left = 1;
+            else
+                zero = 1;
+        }
+        width = 0;
+        if (*fmt == '*') {
+            width = va_arg(ap, int);
+            if (width < 0) {    /* A negative width means '-' */
+                left = 1;
+                width = width == INT_MIN ? INT_MAX : -width;
+            }
+            fmt++;
+        }
+        for (; *fmt >= '0' && *fmt <= '9'; fmt++)
+            width = width * 10 + (*fmt - '0');
+        islong = 0;
+        if (*fmt == 'l' || *fmt == 'z') {
+            islong = 1;
+            fmt++;
+        }
+
+        /* The converted argument, in s[0..len) */
+        s = num;
+        switch (*fmt) {
+        case 'd':
+        case 'i':
+            v = islong ? va_arg(ap, long) : va_arg(ap, int);
+            u = v < 0 ? -(unsigned long) v : (unsigned long) v;
+            if (v < 0) {
+                num[0] = '-';
+                len = 1 + sio_utoa(u, num + 1, 10);
+            }
+            else
+                len = sio_utoa(u, num, 10);
+            break;
+        case 'u':
+        case 'x':
+            u = islong ? va_arg(ap, unsigned long) : va_arg(ap, unsigned);
+            len = sio_utoa(u, num, *fmt == 'x' ? 16 : 10);
+            break;
+        case 's':
+            if ((s = va_arg(ap, const char *)) == NULL)
+                s = "(null)";
+            len = sio_strlen((char *) s);
+            break;
+        case 'c':
+            num[0] = (char) va_arg(ap, int);
+            len = 1;
+            break;
+        case '%':
+            num[0] = '%';
+            len = 1;
+            break;
+        default:                /* Unsupported: copy it through */
+            if (*fmt == '\0')
+                fmt--;
+            num[0] = '%';
+            num[1] = *fmt;
+            len = 2;
+        }
+
+        /* Pad to the width, zeros after any sign */
+        i = 0;
+        if (!left && zero && (*fmt == 'd' || *fmt == 'i') && s[0] == '-')
+            sio_putc(buf, size, &n, s[i++]);
+        for (; !left && width > 0 && (size_t) width > len; width--)
+            sio_putc(buf, size, &n, zero && *fmt != 's' && *fmt != 'c' ?
+                     '0' : ' ');
+        for (; i < len; i++)
+            sio_putc(buf, size, &n, s[i]);
+        for (; left && width > 0 && (size_t) width > len; width--)
+            sio_putc(buf, size, &n, ' ');
+    }
+    if (size > 0)
+        buf[n] = '\0';
+    return n;
+}
+
+ssize_t sio_snprintf(char *buf, size_t size, const char *fmt, ...)
+{
+    va_list ap;
+    ssize_t n;
+
+    va_start(ap, fmt);
+    n = sio_vsnprintf(buf, size, fmt, ap);
+    va_end(ap);
+    return n;
+}
+
+ssize_t sio_printf(const char *fmt, ...) /* Put formatted message */
+{
+    char buf[SIO_BUFSIZE];
+    va_list ap;
+    ssize_t n;
+
+    va_start(ap, fmt);
+    n = sio_vsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+    return write(STDOUT_FILENO, buf, n);
+}
 /* $end siopublic */
 
 /*******************************
@@ -302,6 +450,20 @@ ssize_t Sio_puts(char s[])
     return n;
 }
 
+ssize_t Sio_printf(const char *fmt, ...)
+{
+    char buf[SIO_BUFSIZE];
+    va_list ap;
+    ssize_t n;
+
+    va_start(ap, fmt);
+    n = sio_vsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+    if ((n = write(STDOUT_FILENO, buf, n)) < 0)
+        sio_error("Sio_printf error");
+    return n;
+}
+
 void Sio_error(char s[])
 {
     sio_error(s);
@@ -786,6 +948,47 @@ ssize_t rio_writen(int fd, void *usrbuf, size_t n)
 /* $end rio_writen */
 
 
+/*
+ * rio_fill - Read more into the internal buffer, after its unread
+ *    bytes, which are first moved to its start. A full buffer is grown
+ *    (by doubling, up to RIO_MAXBUFSIZE). Returns the number of bytes
+ *    read, 0 on EOF and -1 on error.
+ */
+static ssize_t rio_fill(rio_t *rp)
+{
+    char *fresh;
+    ssize_t n;
+
+    if (rp->rio_bufptr != rp->rio_base) {
+    memmove(rp->rio_base, rp->rio_bufptr, rp->rio_cnt);
+    rp->rio_bufptr = rp->rio_base;
+    }
+    if (rp->rio_cnt == rp->rio_size) {
+    if (rp->rio_size >= RIO_MAXBUFSIZE) {
+        errno = ENOMEM;
+        return -1;
+    }
+    if (rp->rio_base == rp->rio_buf) {
+        if ((fresh = malloc(2 * rp->rio_size)) != NULL)
+        memcpy(fresh, rp->rio_buf, rp->rio_cnt);
+    }
+    else
+        fresh = realloc(rp->rio_base, 2 * rp->rio_size);
+    if (fresh == NULL)
+        return -1;              /* errno set by malloc() */
+    rp->rio_base = rp->rio_bufptr = fresh;
+    rp->rio_size *= 2;
+    }
+
+    do {
+    n = read(rp->rio_fd, rp->rio_base + rp->rio_cnt,
+         rp->rio_size - rp->rio_cnt);
+    } while (n < 0 && errno == EINTR); /* Interrupted by sig handler return */
+    if (n > 0)
+    rp->rio_cnt += n;
+    return n;
+}
+
 /* 
  * rio_read - This is a wrapper for the Unix read() function that
  *    transfers min(n, rio_cnt) bytes from an internal buffer to a user
@@ -798,18 +1001,11 @@ ssize_t rio_writen(int fd, void *usrbuf, size_t n)
 static ssize_t rio_read(rio_t *rp, char *usrbuf, size_t n)
 {
     int cnt;
+    ssize_t rc;
 
-    while (rp->rio_cnt <= 0) {  /* Refill if buf is empty */
-    rp->rio_cnt = read(rp->rio_fd, rp->rio_buf, 
-               sizeof(rp->rio_buf));
-    if (rp->rio_cnt < 0) {
-        if (errno != EINTR) /* Interrupted by sig handler return */
-        return -1;
-    }
-    else if (rp->rio_cnt == 0)  /* EOF */
-        return 0;
-    else 
-        rp->rio_bufptr = rp->rio_buf; /* Reset buffer ptr */
+    if (rp->rio_cnt <= 0) {     /* Refill if buf is empty */
+    if ((rc = rio_fill(rp)) <= 0)
+        return rc;              /* EOF or error */
     }
 
     /* Copy min(n, rp->rio_cnt) bytes from internal buf to user buf */
@@ -831,7 +1027,8 @@ void rio_readinitb(rio_t *rp, int fd)
 {
     rp->rio_fd = fd;  
     rp->rio_cnt = 0;  
-    rp->rio_bufptr = rp->rio_buf;
+    rp->rio_bufptr = rp->rio_base = rp->rio_buf;
+    rp->rio_size = RIO_BUFSIZE;
 }
 /* $end rio_readinitb */
 
@@ -859,30 +1056,77 @@ ssize_t rio_readnb(rio_t *rp, void *usrbuf, size_t n)
 
 /* 
  * rio_readlineb - Robustly read a text line (buffered)
+ *    Copies the line (at most maxlen - 1 bytes of it) out of the
+ *    internal buffer a run at a time, finding its end with memchr.
  */
 /* $begin rio_readlineb */
 ssize_t rio_readlineb(rio_t *rp, void *usrbuf, size_t maxlen) 
 {
-    int n, rc;
-    char c, *bufp = usrbuf;
+    size_t n = 0, cnt;
+    char *bufp = usrbuf, *nl = NULL;
+    ssize_t rc;
 
-    for (n = 1; n < maxlen; n++) { 
-        if ((rc = rio_read(rp, &c, 1)) == 1) {
-        *bufp++ = c;
-        if (c == '\n') {
-                n++;
-            break;
-            }
-    } else if (rc == 0) {
-        if (n == 1)
-        return 0; /* EOF, no data read */
-        else
-        break;    /* EOF, some data was read */
-    } else
+    if (maxlen == 0)
+    return 0;
+    while (nl == NULL && n < maxlen - 1) {
+    if (rp->rio_cnt <= 0) {
+        if ((rc = rio_fill(rp)) < 0)
         return -1;    /* Error */
+        else if (rc == 0)
+        break;        /* EOF */
+    }
+    cnt = maxlen - 1 - n;
+    if (rp->rio_cnt < cnt)
+        cnt = rp->rio_cnt;
+    if ((nl = memchr(rp->rio_bufptr, '\n', cnt)) != NULL)
+        cnt = nl - rp->rio_bufptr + 1;
+    memcpy(bufp + n, rp->rio_bufptr, cnt);
+    rp->rio_bufptr += cnt;
+    rp->rio_cnt -= cnt;
+    n += cnt;
     }
-    *bufp = 0;
-    return n-1;
+    bufp[n] = 0;
+    return n;
+}
+/* $end rio_readlineb */
+
+/*
+ * rio_borrowlineb - Read a text line in place (buffered)
+ *    Points *linep at the next line, newline included, where it lies in
+ *    the internal buffer, and returns its length (0 on EOF, -1 on
+ *    error). The line is not NUL-terminated and is only valid until the
+ *    next call on rp. The buffer grows to hold a line longer than it;
+ *    rio_freeb frees it.
+ */
+ssize_t rio_borrowlineb(rio_t *rp, char **linep)
+{
+    size_t scanned = 0;         /* Unread bytes known to hold no newline */
+    char *nl;
+    ssize_t rc, n;
+
+    while ((nl = memchr(rp->rio_bufptr + scanned, '\n',
+                        rp->rio_cnt - scanned)) == NULL) {
+    scanned = rp->rio_cnt;
+    if ((rc = rio_fill(rp)) < 0)
+        return -1;              /* Error */
+    if (rc == 0)
+        break;                  /* EOF: the rest is the last line */
+    }
+    n = nl != NULL ? nl - rp->rio_bufptr + 1 : rp->rio_cnt;
+    *linep = rp->rio_bufptr;
+    rp->rio_bufptr += n;
+    rp->rio_cnt -= n;
+    return n;
+}
+
+/*
+ * rio_freeb - Free the buffer that rio_borrowlineb grew, if it did
+ */
+void rio_freeb(rio_t *rp)
+{
+    if (rp->rio_base != rp->rio_buf)
+    free(rp->rio_base);
+    rio_readinitb(rp, rp->rio_fd);
 }
 /* $end rio_readlineb */
 
@@ -927,6 +1171,15 @@ ssize_t Rio_readlineb(rio_t *rp, void *usrbuf, size_t maxlen)
     return rc;
 } 
 
+ssize_t Rio_borrowlineb(rio_t *rp, char **linep)
+{
+    ssize_t rc;
+
+    if ((rc = rio_borrowlineb(rp, linep)) < 0)
+    unix_error("Rio_borrowlineb error");
+    return rc;
+}
+
 /******************************** 
  * Client/server helper functions
  ********************************/
@@ -43,11 +43,14 @@ typedef struct sockaddr SA;
 /* Persistent state for the robust I/O (Rio) package */
 /* $begin rio_t */
 #define RIO_BUFSIZE 8192
+#define RIO_MAXBUFSIZE (1 << 30) /* Largest the buffer grows to */
 typedef struct {
     int rio_fd;                /* Descriptor for this internal buf */
     int rio_cnt;               /* Unread bytes in internal buf */
     char *rio_bufptr;          /* Next unread byte in internal buf */
-    char rio_buf[RIO_BUFSIZE]; /* Internal buffer */
+    char *rio_base;            /* Internal buf (rio_buf until grown) */
+    size_t rio_size;           /* Size of internal buf */
+    char rio_buf[RIO_BUFSIZE]; /* Initial internal buffer */
 } rio_t;
 /* $end rio_t */
 
@@ -59,6 +62,7 @@ extern char **environ; /* Defined by libc */
 #define MAXLINE  8192  /* Max text line length */
 #define MAXBUF   8192  /* Max I/O buffer size */
 #define LISTENQ  1024  /* Second argument to listen() */
+#define SIO_BUFSIZE 1024 /* Max sio_printf message (a stack buffer) */
 
 /* Our own error-handling functions */
 void unix_error(char *msg);
@@ -93,11 +97,15 @@ int Sigsuspend(const sigset_t *set);
 /* Sio (Signal-safe I/O) routines */
 ssize_t sio_puts(char s[]);
 ssize_t sio_putl(long v);
+ssize_t sio_vsnprintf(char *buf, size_t size, const char *fmt, va_list ap);
+ssize_t sio_snprintf(char *buf, size_t size, const char *fmt, ...);
+ssize_t sio_printf(const char *fmt, ...);
 void sio_error(char s[]);
 
 /* Sio wrappers */
 ssize_t Sio_puts(char s[]);
 ssize_t Sio_putl(long v);
+ssize_t Sio_printf(const char *fmt, ...);
 void Sio_error(char s[]);
 
 /* Unix I/O wrappers */
@@ -178,6 +186,8 @@ ssize_t rio_writen(int fd, void *usrbuf, size_t n);
 void rio_readinitb(rio_t *rp, int fd); 
 ssize_t rio_readnb(rio_t *rp, void *usrbuf, size_t n);
 ssize_t rio_readlineb(rio_t *rp, void *usrbuf, size_t maxlen);
+ssize_t rio_borrowlineb(rio_t *rp, char **linep);
+void rio_freeb(rio_t *rp);
 
 /* Wrappers for Rio package */
 ssize_t Rio_readn(int fd, void *usrbuf, size_t n);
@@ -185,6 +195,7 @@ void Rio_writen(int fd, void *usrbuf, size_t n);
 void Rio_readinitb(rio_t *rp, int fd); 
 ssize_t Rio_readnb(rio_t *rp, void *usrbuf, size_t n);
 ssize_t Rio_readlineb(rio_t *rp, void *usrbuf, size_t maxlen);
+ssize_t Rio_borrowlineb(rio_t *rp, char **linep);
 
 /* Reentrant protocol-independent client/server helpers */
 int open_clientfd(char *hostname, char *port);
@@ -0,0 +1,382 @@
+/* envtab.c
+ * environment table for tshlab
+ */
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+#include "arena.h"
+#include "envtab.h"
+
+#define ENV_INIT        64      // initial room in the envp array
+#define ENV_COMPACT     65536   // dead string bytes tolerated
+
+// Characters of a variable name
+#define NAME_CHARS  "abcdefghijklmnopqrstuvwxyz" \
+                    "ABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789_"
+
+extern char **environ;
+
+struct env_undo                 // A variable swapped by env_overlay
+{
+    char **slot;                // Where in envp
+    char *old;                  // What was there
+};
+
+static struct arena strings;    // The "NAME=value" strings
+static size_t live;             // Bytes of the strings still in use
+static char **slots;            // ENV_SLACK free slots, then envp
+static char **envp;             // The variables, NULL-terminated
+static int count;               // Variables in envp
+static int room;                // Room in envp, terminator included
+static int *idx;                // Hash index: position in envp + 1, or 0
+static unsigned nidx;           // Size of idx (power of 2)
+
+static struct env_undo undo[ENV_SLACK]; // Swaps made by env_overlay
+static int nundo;                       // Number of swaps
+
+/* hash_name - FNV-1a hash of the len bytes of a name */
+static unsigned hash_name(const char *name, size_t len)
+{
+    unsigned h = 2166136261u;
+
+    while (len-- > 0)
+    {
+        h ^= (unsigned char) *name++;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+/*
+ * probe - Index slot of the variable whose name is the len bytes at
+ * name, or the empty slot where it would go
+ */
+static unsigned probe(const char *name, size_t len)
+{
+    unsigned i = hash_name(name, len) & (nidx - 1);
+    const char *v;
+
+    while (idx[i] != 0)
+    {
+        v = envp[idx[i] - 1];
+        if (strncmp(v, name, len) == 0 && v[len] == '=')
+        {
+            break;
+        }
+        i = (i + 1) & (nidx - 1);
+    }
+    return i;
+}
+
+/* reindex - Rebuild the index, at least twice the size of envp */
+static bool reindex(void)
+{
+    unsigned n = nidx ? nidx : 2 * ENV_INIT;
+    int *fresh;
+    int pos;
+
+    while (n < 2 * (unsigned) room)
+    {
+        n *= 2;
+    }
+    if ((fresh = calloc(n, sizeof(int))) == NULL)
+    {
+        return false;
+    }
+    free(idx);
+    idx = fresh;
+    nidx = n;
+    for (pos = 0; pos < count; pos++)
+    {
+        const char *v = envp[pos];
+        idx[probe(v, strchr(v, '=') - v)] = pos + 1;
+    }
+    return true;
+}
+
+/* grow - Double the room in envp */
+static bool grow(void)
+{
+    char **fresh = realloc(slots, (ENV_SLACK + 2 * room) * sizeof(char *));
+
+    if (fresh == NULL)
+    {
+        return false;
+    }
+    slots = fresh;
+    envp = environ = slots + ENV_SLACK;
+    room *= 2;
+    return reindex();
+}
+
+/* compact - Copy the live strings to the start of the arena */
+static bool compact(void)
+{
+    char *copy = malloc(live), *p = copy;
+    size_t n;
+    int pos;
+
+    if (copy == NULL)
+    {
+        return false;
+    }
+    for (pos = 0; pos < count; pos++)
+    {
+        n = strlen(envp[pos]) + 1;
+        memcpy(p, envp[pos], n);
+        p += n;
+    }
+    arena_reset(&strings);
+    for (p = copy, pos = 0; pos < count; pos++, p += n)
+    {
+        n = strlen(p) + 1;
+        envp[pos] = arena_alloc(&strings, n);
+        memcpy(envp[pos], p, n);
+    }
+    free(copy);
+    return true;
+}
+
+/* store - Copy a string into the arena */
+static char *store(const char *s)
+{
+    size_t n = strlen(s) + 1;
+    size_t dead = strings.used - live;
+    char *copy;
+
+    if (dead > ENV_COMPACT && dead > live && !compact())
+    {
+        return NULL;
+    }
+    if ((copy = arena_alloc(&strings, n)) == NULL)
+    {
+        return NULL;
+    }
+    memcpy(copy, s, n);
+    live += n;
+    return copy;
+}
+
+/* put - Set a variable from an assignment whose name is len bytes */
+static bool put(const char *assign, size_t len)
+{
+    unsigned i = probe(assign, len);
+    char *s, **slot;
+
+    if ((s = store(assign)) == NULL)
+    {
+        return false;
+    }
+    if (idx[i] != 0)
+    {
+        slot = &envp[idx[i] - 1];
+        live -= strlen(*slot) + 1;
+        *slot = s;
+        return true;
+    }
+    if (count + 1 == room)
+    {
+        if (!grow())
+        {
+            return false;
+        }
+        i = probe(assign, len);
+    }
+    envp[count++] = s;
+    envp[count] = NULL;
+    idx[i] = count;
+    return true;
+}
+
+/* env_init - Copy the initial environment into the table */
+bool env_init(char **init)
+{
+    const char *eq;
+    int n = 0;
+
+    while (init[n] != NULL)
+    {
+        n++;
+    }
+    for (room = ENV_INIT; room <= n; room *= 2)
+        ;
+    if (!arena_init(&strings, ENV_MAXBYTES, 0) ||
+        (slots = malloc((ENV_SLACK + room) * sizeof(char *))) == NULL)
+    {
+        return false;
+    }
+    envp = slots + ENV_SLACK;
+    envp[0] = NULL;
+    if (!reindex())
+    {
+        return false;
+    }
+    for (; *init != NULL; init++)
+    {
+        // Names need not be identifiers here; they are passed on as is
+        if ((eq = strchr(*init, '=')) != NULL && eq > *init &&
+            !put(*init, eq - *init))
+        {
+            return false;
+        }
+    }
+    environ = envp;
+    return true;
+}
+
+/* env_validname - Is name a variable name? */
+bool env_validname(const char *name)
+{
+    size_t len = strspn(name, NAME_CHARS);
+
+    return len > 0 && name[len] == '\0' && !isdigit((unsigned char) name[0]);
+}
+
+/* env_namelen - Length of the name of an assignment, 0 if not one */
+size_t env_namelen(const char *word)
+{
+    size_t len = strspn(word, NAME_CHARS);
+
+    if (len == 0 || word[len] != '=' || isdigit((unsigned char) word[0]))
+    {
+        return 0;
+    }
+    return len;
+}
+
+/* env_get - Value of a variable */
+const char *env_get(const char *name)
+{
+    size_t len = strlen(name);
+    unsigned i = probe(name, len);
+
+    return idx[i] != 0 ? envp[idx[i] - 1] + len + 1 : NULL;
+}
+
+/* env_put - Set a variable */
+bool env_put(const char *assign)
+{
+    const char *eq = strchr(assign, '=');
+
+    return eq != NULL && put(assign, eq - assign);
+}
+
+/* env_unset - Remove a variable */
+void env_unset(const char *name)
+{
+    unsigned i = probe(name, strlen(name));
+    int pos;
+
+    if (idx[i] == 0)
+    {
+        return;
+    }
+    pos = idx[i] - 1;
+    live -= strlen(envp[pos]) + 1;
+    envp[pos] = envp[--count];
+    envp[count] = NULL;
+    // Positions moved; unset is rare enough to rebuild the index for it
+    reindex();
+}
+
+/*
+ * find_new - Position among the n entries at v of the assignment to the
+ * same name as assign, or -1
+ */
+static int find_new(char **v, int n, const char *assign, size_t len)
+{
+    int k;
+
+    for (k = 0; k < n; k++)
+    {
+        if (strncmp(v[k], assign, len + 1) == 0)
+        {
+            return k;
+        }
+    }
+    return -1;
+}
+
+/* env_overlay - The environment with some assignments applied */
+char **env_overlay(char *const *assigns, int n, struct arena *scratch)
+{
+    char **front = envp, **copy;
+    int k, pos, nnew;
+    size_t len;
+    unsigned i;
+
+    // Variables that exist are swapped in place, new ones go in front
+    nundo = 0;
+    for (k = 0; k < n; k++)
+    {
+        len = env_namelen(assigns[k]);
+        i = probe(assigns[k], len);
+        if (idx[i] != 0)
+        {
+            if (nundo == ENV_SLACK)
+            {
+                break;
+            }
+            undo[nundo].slot = &envp[idx[i] - 1];
+            undo[nundo].old = envp[idx[i] - 1];
+            envp[idx[i] - 1] = assigns[k];
+            nundo++;
+        }
+        else if ((pos = find_new(front, envp - front, assigns[k], len)) >= 0)
+        {
+            front[pos] = assigns[k];
+        }
+        else if (front > slots)
+        {
+            *--front = assigns[k];
+        }
+        else
+        {
+            break;
+        }
+    }
+    if (k == n)
+    {
+        return front;
+    }
+
+    // Too many to fit: copy the pointers, then apply them to the copy
+    env_restore();
+    if ((copy = arena_alloc(scratch, (count + n + 1) * sizeof(char *))) ==
+        NULL)
+    {
+        return NULL;
+    }
+    memcpy(copy, envp, count * sizeof(char *));
+    nnew = 0;
+    for (k = 0; k < n; k++)
+    {
+        len = env_namelen(assigns[k]);
+        i = probe(assigns[k], len);
+        if (idx[i] != 0)
+        {
+            copy[idx[i] - 1] = assigns[k];
+        }
+        else if ((pos = find_new(copy + count, nnew, assigns[k], len)) >= 0)
+        {
+            copy[count + pos] = assigns[k];
+        }
+        else
+        {
+            copy[count + nnew++] = assigns[k];
+        }
+    }
+    copy[count + nnew] = NULL;
+    return copy;
+}
+
+/* env_restore - Put back what env_overlay swapped */
+void env_restore(void)
+{
+    while (nundo > 0)
+    {
+        nundo--;
+        *undo[nundo].slot = undo[nundo].old;
+    }
+}
@@ -0,0 +1,79 @@
+/*
+ * envtab.h: environment table for tshlab
+ *
+ * envtab.h defines the environment that tsh hands to its jobs, and that
+ * the export and unset builtins change. Each variable is a "NAME=value"
+ * string in an arena of its own, found through a hash index on NAME,
+ * and the strings are listed in an envp array that environ points to,
+ * so getenv() and the jobs see the same variables. Setting a variable
+ * only appends a string and swaps one pointer; the space of replaced
+ * strings is recovered by compacting the arena once it is mostly dead.
+ *
+ * The envp array keeps ENV_SLACK free slots in front of it. A command
+ * run with assignments (VAR=val cmd) gets the array itself, with the
+ * assignments to existing variables swapped in and new variables put
+ * in the free slots, rather than a copy of the whole environment. The
+ * array is put back once the command has been launched.
+ */
+
+#ifndef __ENVTAB_H__
+#define __ENVTAB_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+
+struct arena;
+
+#define ENV_SLACK       16              // free slots in front of envp
+#define ENV_MAXBYTES    (1L << 26)      // address space for the strings
+
+/*
+ * env_init copies the variables of envp into the table and points
+ * environ at it. Returns false if there is not enough memory.
+ */
+bool env_init(char **envp);
+
+/*
+ * env_namelen returns the length of the name if word is an assignment
+ * (a valid name followed by '='), and 0 otherwise.
+ */
+size_t env_namelen(const char *word);
+
+/*
+ * env_validname returns true if name is a valid variable name: letters,
+ * digits and '_', not starting with a digit.
+ */
+bool env_validname(const char *name);
+
+/*
+ * env_get returns the value of the named variable, or NULL if unset.
+ */
+const char *env_get(const char *name);
+
+/*
+ * env_put sets a variable from an assignment ("NAME=value", which is
+ * copied). Returns false if there is not enough memory.
+ */
+bool env_put(const char *assign);
+
+/*
+ * env_unset removes the named variable, if it is set.
+ */
+void env_unset(const char *name);
+
+/*
+ * env_overlay returns an envp holding the environment with the n
+ * assignments of assigns applied (the last one wins for a name). The
+ * assignment strings are used in place, and must outlive the envp,
+ * which stays valid until env_restore. If they do not fit in ENV_SLACK
+ * slots, the envp is a copy of the pointers allocated from scratch.
+ * Returns NULL if scratch does not have the space.
+ */
+char **env_overlay(char *const *assigns, int n, struct arena *scratch);
+
+/*
+ * env_restore undoes env_overlay.
+ */
+void env_restore(void);
+
+#endif
@@ -0,0 +1,198 @@
+/* eventloop.c
+ * signalfd/epoll event loop for tshlab
+ */
+
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include "eventloop.h"
+
+static int sig_fd = -1;         // signalfd of the blocked signals
+static int epoll_fd = -1;       // epoll instance watching sig_fd and in_fd
+static int in_fd = -1;          // Input descriptor
+static bool in_polled;          // in_fd is watched by epoll
+static bool in_eof;             // in_fd reached end of file
+
+static char inbuf[EVLOOP_BUFSIZE];  // Input read
+static size_t instart;              // First byte of inbuf not yet returned
+static size_t inlen;                // Bytes in inbuf
+
+/* evloop_init - Route the signals through a signalfd and set up epoll */
+bool evloop_init(int fd, const sigset_t *sigs)
+{
+    struct epoll_event ev;
+    sigset_t prev;
+    int saved;
+
+    if (sigprocmask(SIG_BLOCK, sigs, &prev) < 0)
+    {
+        return false;
+    }
+    if ((sig_fd = signalfd(-1, sigs, SFD_NONBLOCK | SFD_CLOEXEC)) < 0 ||
+        (epoll_fd = epoll_create1(EPOLL_CLOEXEC)) < 0)
+    {
+        goto fail;
+    }
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.fd = sig_fd;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, sig_fd, &ev) < 0)
+    {
+        goto fail;
+    }
+    ev.data.fd = fd;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) == 0)
+    {
+        in_polled = true;
+    }
+    else if (errno != EPERM)
+    {
+        goto fail;
+    }
+    in_fd = fd;
+    return true;
+
+fail:
+    saved = errno;
+    if (sig_fd >= 0)
+    {
+        close(sig_fd);
+    }
+    if (epoll_fd >= 0)
+    {
+        close(epoll_fd);
+    }
+    sig_fd = epoll_fd = -1;
+    sigprocmask(SIG_SETMASK, &prev, NULL);
+    errno = saved;
+    return false;
+}
+
+/* take_line - Copy a buffered line out, if a whole one (or EOF) is there */
+static bool take_line(char *line, size_t size)
+{
+    char *nl = memchr(inbuf + instart, '\n', inlen - instart);
+    size_t n;
+
+    if (nl != NULL)
+    {
+        n = nl - (inbuf + instart) + 1;
+    }
+    else if (in_eof || (instart == 0 && inlen == sizeof(inbuf)))
+    {
+        n = inlen - instart;    // Last line, or one too long to buffer
+    }
+    else
+    {
+        return false;
+    }
+    if (n == 0)
+    {
+        return false;
+    }
+    if (n > size - 1)
+    {
+        n = size - 1;           // Like fgets: the rest comes next time
+    }
+    memcpy(line, inbuf + instart, n);
+    line[n] = '\0';
+    instart += n;               // Moved to the front by the next fill
+    return true;
+}
+
+/* fill - Read what the input has; only called once it is readable */
+static bool fill(void)
+{
+    ssize_t n;
+
+    if (instart > 0)
+    {
+        memmove(inbuf, inbuf + instart, inlen - instart);
+        inlen -= instart;
+        instart = 0;
+    }
+    do
+    {
+        n = read(in_fd, inbuf + inlen, sizeof(inbuf) - inlen);
+    } while (n < 0 && errno == EINTR);
+    if (n < 0)
+    {
+        return false;
+    }
+    if (n == 0)
+    {
+        in_eof = true;
+    }
+    inlen += n;
+    return true;
+}
+
+/* evloop_next - Wait for the next signal or input line */
+evloop_event evloop_next(bool want_line, char *line, size_t size,
+                         int *signo, pid_t *pid)
+{
+    struct signalfd_siginfo si;
+    struct epoll_event evs[2];
+    bool line_ready, in_ready;
+    int i, n, timeout;
+
+    for (;;)
+    {
+        if (read(sig_fd, &si, sizeof(si)) == sizeof(si))
+        {
+            *signo = si.ssi_signo;
+            *pid = si.ssi_pid;
+            return EVLOOP_SIGNAL;
+        }
+
+        line_ready = want_line &&
+            (memchr(inbuf + instart, '\n', inlen - instart) != NULL ||
+             in_eof || (instart == 0 && inlen == sizeof(inbuf)));
+        if (line_ready)
+        {
+            if (take_line(line, size))
+            {
+                return EVLOOP_LINE;
+            }
+            return EVLOOP_EOF;
+        }
+
+        if (!want_line)
+        {
+            // Pending input would keep epoll ready: wait on signals only
+            struct pollfd pfd = { sig_fd, POLLIN, 0 };
+            if (poll(&pfd, 1, -1) < 0 && errno != EINTR)
+            {
+                return EVLOOP_ERROR;
+            }
+            continue;
+        }
+
+        // Unwatchable input is always ready, so only poll the signals
+        timeout = in_polled ? -1 : 0;
+        n = epoll_wait(epoll_fd, evs, 2, timeout);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return EVLOOP_ERROR;
+        }
+        in_ready = !in_polled;
+        for (i = 0; i < n; i++)
+        {
+            if (evs[i].data.fd == in_fd)
+            {
+                in_ready = true;
+            }
+        }
+        if (in_ready && !fill())
+        {
+            return EVLOOP_ERROR;
+        }
+    }
+}
@@ -0,0 +1,53 @@
+/*
+ * eventloop.h: signalfd/epoll event loop for tshlab
+ *
+ * eventloop.h defines the alternative core of tsh's read/eval loop
+ * (tsh -e). The signals the shell handles are blocked for good and
+ * delivered through a signalfd, which is multiplexed with the input
+ * descriptor by epoll, so no asynchronous handler ever runs and the
+ * shell can react to a child while it waits for input.
+ *
+ * The input descriptor is left in blocking mode, since it is usually
+ * shared with other processes; it is only read once epoll reports it
+ * readable. Descriptors epoll cannot watch (regular files) are treated
+ * as always readable. Input is split into lines here, so a line that
+ * is already buffered never waits for epoll.
+ */
+
+#ifndef __EVENTLOOP_H__
+#define __EVENTLOOP_H__
+
+#include <signal.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+#define EVLOOP_BUFSIZE  65536   // input read at a time
+
+// What evloop_next returns
+typedef enum evloop_event
+{
+    EVLOOP_SIGNAL,              // A signal arrived
+    EVLOOP_LINE,                // An input line is ready
+    EVLOOP_EOF,                 // The input is exhausted
+    EVLOOP_ERROR                // A system call failed (errno is set)
+} evloop_event;
+
+/*
+ * evloop_init blocks the signals in sigs and prepares to receive them,
+ * and the lines read from fd, through evloop_next. Returns false and
+ * sets errno on failure, with the signal mask unchanged.
+ */
+bool evloop_init(int fd, const sigset_t *sigs);
+
+/*
+ * evloop_next waits for the next event. Pending signals are returned
+ * first, one per call, with their number and sending pid. With
+ * want_line, a complete input line also ends the wait: it is copied to
+ * line like fgets does (at most size - 1 bytes, the newline included).
+ * Without it, input is left alone.
+ */
+evloop_event evloop_next(bool want_line, char *line, size_t size,
+                         int *signo, pid_t *pid);
+
+#endif
@@ -0,0 +1,157 @@
+/* fcopy.c
+ * in-kernel file copy for tshlab
+ *
+ * copy_file_range and splice need _GNU_SOURCE, so like launch.c this
+ * file does not include csapp.h.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include "fcopy.h"
+
+/* refused - Did the kernel refuse the call for these descriptors? */
+static bool refused(int err)
+{
+    return err == EINVAL || err == ENOSYS || err == EXDEV ||
+           err == EOPNOTSUPP || err == EBADF || err == ETXTBSY ||
+           err == EPERM;
+}
+
+/* write_error - Is err an error of writing rather than of reading? */
+static bool write_error(int err)
+{
+    return err == ENOSPC || err == EDQUOT || err == EFBIG ||
+           err == EPIPE || err == EAGAIN;
+}
+
+/* copy_rw - Copy with read and write */
+static off_t copy_rw(int in_fd, int out_fd, bool *out_failed)
+{
+    static char buf[FCOPY_BUFSIZE];
+    off_t total = 0;
+    ssize_t n, done, k;
+
+    for (;;)
+    {
+        if ((n = read(in_fd, buf, sizeof(buf))) < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            *out_failed = false;
+            return -1;
+        }
+        if (n == 0)
+        {
+            return total;
+        }
+        for (done = 0; done < n; done += k)
+        {
+            if ((k = write(out_fd, buf + done, n - done)) < 0)
+            {
+                if (errno == EINTR)
+                {
+                    k = 0;
+                    continue;
+                }
+                *out_failed = true;
+                return -1;
+            }
+        }
+        total += n;
+    }
+}
+
+/* copy_kernel - One call of method; returns what it does */
+static ssize_t copy_kernel(fcopy_method method, int in_fd, int out_fd)
+{
+    switch (method)
+    {
+    case FCOPY_RANGE:
+        return copy_file_range(in_fd, NULL, out_fd, NULL, FCOPY_CHUNK, 0);
+    case FCOPY_SPLICE:
+        return splice(in_fd, NULL, out_fd, NULL, FCOPY_CHUNK, SPLICE_F_MORE);
+    default:
+        return sendfile(out_fd, in_fd, NULL, FCOPY_CHUNK);
+    }
+}
+
+/* fcopy - Copy the rest of in_fd to out_fd */
+off_t fcopy(int in_fd, int out_fd, bool *out_failed, fcopy_method *method)
+{
+    struct stat in, out;
+    fcopy_method m;
+    off_t total = 0, rest;
+    ssize_t n;
+
+    if (fstat(in_fd, &in) < 0)
+    {
+        *out_failed = false;
+        return -1;
+    }
+    if (fstat(out_fd, &out) < 0)
+    {
+        *out_failed = true;
+        return -1;
+    }
+    if (S_ISFIFO(in.st_mode) || S_ISFIFO(out.st_mode))
+    {
+        m = FCOPY_SPLICE;
+    }
+    else if (!S_ISREG(in.st_mode) || in.st_size == 0)
+    {
+        // Nothing to say how much there is: /proc, devices, sockets
+        m = FCOPY_RW;
+    }
+    else if (S_ISREG(out.st_mode))
+    {
+        m = FCOPY_RANGE;
+    }
+    else
+    {
+        m = FCOPY_SENDFILE;
+    }
+
+    while (m != FCOPY_RW)
+    {
+        if ((n = copy_kernel(m, in_fd, out_fd)) > 0)
+        {
+            total += n;
+            continue;
+        }
+        if (n == 0)
+        {
+            break;
+        }
+        if (errno == EINTR)
+        {
+            continue;
+        }
+        if (!refused(errno))
+        {
+            *out_failed = write_error(errno);
+            return -1;
+        }
+        // sendfile can still do what copy_file_range or splice would not
+        m = m == FCOPY_RANGE || (m == FCOPY_SPLICE && S_ISREG(in.st_mode)) ?
+            FCOPY_SENDFILE : FCOPY_RW;
+    }
+    if (method != NULL)
+    {
+        *method = m;
+    }
+    if (m != FCOPY_RW)
+    {
+        return total;
+    }
+    if ((rest = copy_rw(in_fd, out_fd, out_failed)) < 0)
+    {
+        return -1;
+    }
+    return total + rest;
+}
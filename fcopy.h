@@ -0,0 +1,44 @@
+/*
+ * fcopy.h: in-kernel file copy for tshlab
+ *
+ * fcopy.h defines the copy behind the cat builtin, which moves bytes
+ * from one descriptor to another without bringing them into the shell.
+ * It picks the system call from the types of the two descriptors:
+ *
+ *     regular file to regular file    copy_file_range
+ *     pipe to anything                splice
+ *     anything to pipe                splice
+ *     regular file to anything else   sendfile
+ *
+ * and falls back to read and write when the kernel refuses the call
+ * (for instance across file systems on older kernels, or for files of
+ * /proc, which have no size).
+ */
+
+#ifndef __FCOPY_H__
+#define __FCOPY_H__
+
+#include <stdbool.h>
+#include <sys/types.h>
+
+#define FCOPY_CHUNK     (1 << 30)       // most asked of one system call
+#define FCOPY_BUFSIZE   (128 * 1024)    // buffer of the read/write copy
+
+typedef enum fcopy_method
+{
+    FCOPY_RANGE,                // copy_file_range
+    FCOPY_SPLICE,               // splice
+    FCOPY_SENDFILE,             // sendfile
+    FCOPY_RW                    // read and write
+} fcopy_method;
+
+/*
+ * fcopy copies everything from in_fd, from its offset up to its end, to
+ * out_fd, advancing both offsets. Returns the number of bytes copied,
+ * or -1 with errno set on failure, in which case *out_failed tells
+ * whether it was writing (rather than reading) that failed. If method
+ * is not NULL, it is set to the way the last bytes were copied.
+ */
+off_t fcopy(int in_fd, int out_fd, bool *out_failed, fcopy_method *method);
+
+#endif
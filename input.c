@@ -0,0 +1,182 @@
+/* input.c
+ * command input for tshlab
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "input.h"
+
+static char stdin_buf[INPUT_BUFSIZE];
+
+static int in_fd = STDIN_FILENO;        // Descriptor read when buf runs dry
+static char *buf = stdin_buf;           // Buffered input (or the script)
+static size_t bufsize = INPUT_BUFSIZE;  // Size of buf
+static size_t start;                    // Next byte to hand out
+static size_t end;                      // End of the buffered input
+static bool at_eof;                     // Nothing more to read into buf
+static bool failed;                     // A read failed
+
+/* input_open - Map a script file as the whole input */
+bool input_open(const char *path)
+{
+    struct stat st;
+    void *map = NULL;
+    int fd;
+
+    if ((fd = open(path, O_RDONLY | O_CLOEXEC)) < 0)
+    {
+        return false;
+    }
+    if (fstat(fd, &st) < 0)
+    {
+        close(fd);
+        return false;
+    }
+    if (st.st_size > 0)
+    {
+        // Private and writable: newlines are overwritten in place
+        map = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+                   fd, 0);
+        if (map == MAP_FAILED)
+        {
+            int saved = errno;
+            close(fd);
+            errno = saved;
+            return false;
+        }
+        madvise(map, st.st_size, MADV_SEQUENTIAL);
+    }
+    close(fd);
+
+    if (map != NULL)
+    {
+        buf = map;
+    }
+    bufsize = end = st.st_size;
+    start = 0;
+    at_eof = true;
+    in_fd = -1;
+    return true;
+}
+
+/* input_string - Make a string the whole input */
+void input_string(char *s)
+{
+    buf = s;
+    bufsize = end = strlen(s);
+    start = 0;
+    at_eof = true;
+    in_fd = -1;
+}
+
+/* fill - Read more input after what is buffered */
+static void fill(void)
+{
+    ssize_t n;
+
+    // Move the unread input to the front first
+    if (start > 0)
+    {
+        memmove(buf, buf + start, end - start);
+        end -= start;
+        start = 0;
+    }
+    do
+    {
+        n = read(in_fd, buf + end, bufsize - end);
+    } while (n < 0 && errno == EINTR);
+    if (n < 0)
+    {
+        failed = at_eof = true;
+    }
+    else if (n == 0)
+    {
+        at_eof = true;
+    }
+    else
+    {
+        end += n;
+    }
+}
+
+/* input_line - Hand out the next whole line where it lies */
+char *input_line(void)
+{
+    char *line, *nl;
+
+    for (;;)
+    {
+        line = buf + start;
+        if ((nl = memchr(line, '\n', end - start)) != NULL)
+        {
+            *nl = '\0';
+            start = nl - buf + 1;
+            return line;
+        }
+        // Unless the line is partial and there is room to read the rest,
+        // leave it to input_gets
+        if (at_eof || (start == 0 && end == bufsize))
+        {
+            return NULL;
+        }
+        fill();
+    }
+}
+
+/* input_gets - Copy out the next piece of input, like fgets */
+bool input_gets(char *dst, size_t size)
+{
+    char *nl;
+    size_t n;
+
+    while (start == end)
+    {
+        if (at_eof)
+        {
+            return false;
+        }
+        fill();
+    }
+    n = end - start;
+    if ((nl = memchr(buf + start, '\n', n)) != NULL)
+    {
+        n = nl - (buf + start) + 1;
+    }
+    if (n > size - 1)
+    {
+        n = size - 1;
+    }
+    memcpy(dst, buf + start, n);
+    dst[n] = '\0';
+    start += n;
+    return true;
+}
+
+/* input_atend - Is nothing but white space left? */
+bool input_atend(void)
+{
+    size_t i;
+
+    if (!at_eof)
+    {
+        return false;
+    }
+    for (i = start; i < end; i++)
+    {
+        if (buf[i] != ' ' && buf[i] != '\t' && buf[i] != '\n')
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* input_error - Did a read fail? */
+bool input_error(void)
+{
+    return failed;
+}
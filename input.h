@@ -0,0 +1,62 @@
+/*
+ * input.h: command input for tshlab
+ *
+ * input.h defines where tsh reads its command lines from when it is not
+ * running the event loop: a script file named on the command line,
+ * which is mapped into memory, the command string of tsh -c, or
+ * standard input, which is read through a large read-ahead buffer so
+ * that one read() brings in many lines when tsh is fed by a pipe.
+ *
+ * In every case a whole line is normally handed out where it lies, with
+ * its newline replaced by a NUL, so it is never copied or scanned
+ * twice. Only a line that does not fit in the buffer, or a last line
+ * with no newline, has to be copied out in pieces with input_gets.
+ */
+
+#ifndef __INPUT_H__
+#define __INPUT_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#define INPUT_BUFSIZE   (256 * 1024)    // stdin read-ahead buffer
+
+/*
+ * input_open makes the file at path the input, mapping it into memory.
+ * Returns false and sets errno on failure.
+ */
+bool input_open(const char *path);
+
+/*
+ * input_string makes the NUL-terminated string s the input (tsh -c). Its
+ * newlines are overwritten as lines are handed out.
+ */
+void input_string(char *s);
+
+/*
+ * input_line returns the next line, without its newline, in place. It
+ * stays valid until the next call. Returns NULL at the end of the input,
+ * or if the next line has to be read with input_gets instead.
+ */
+char *input_line(void);
+
+/*
+ * input_gets copies the next piece of input, up to and including a
+ * newline, to buf, like fgets (at most size - 1 bytes). Returns false at
+ * the end of the input or on a read error.
+ */
+bool input_gets(char *buf, size_t size);
+
+/*
+ * input_atend returns true if the lines handed out so far are all there
+ * is: the input is a script or string, and only white space is left.
+ * Standard input is never known to be at its end until a read says so.
+ */
+bool input_atend(void);
+
+/*
+ * input_error returns true if reading the input failed (errno is set).
+ */
+bool input_error(void);
+
+#endif
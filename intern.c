@@ -0,0 +1,195 @@
+/* intern.c
+ * interned string storage for tshlab
+ */
+
+#include "csapp.h"
+#include "intern.h"
+
+#define INTERN_BUCKETS  64      // initial number of hash buckets
+#define INTERN_ALIGN    8       // alignment of strings in a chunk
+
+struct intern_chunk             // A block of the string arena
+{
+    struct intern_chunk *next;  // Next retired chunk
+    size_t size;                // Bytes of data
+    size_t used;                // Bytes handed out
+    unsigned live;              // Strings still referenced
+    char data[];                // The strings
+};
+
+struct intern_str               // An interned string
+{
+    struct intern_str *next;    // Next string in the bucket
+    struct intern_chunk *chunk; // Chunk it lives in
+    unsigned hash;              // Hash of text
+    unsigned refs;              // References held
+    char text[];                // The string
+};
+
+static struct intern_str **buckets; // The hash table
+static unsigned nbuckets;           // Number of buckets (power of 2)
+static unsigned nstrings;           // Number of interned strings
+
+static struct intern_chunk *current;    // Chunk being filled
+static struct intern_chunk *retired;    // Empty chunks waiting for free()
+static size_t arena_bytes;              // Bytes handed out, all chunks
+
+/* hash_str - FNV-1a hash of a string, also returning its length */
+static unsigned hash_str(const char *s, size_t *len)
+{
+    const char *p = s;
+    unsigned h = 2166136261u;
+
+    while (*p != '\0')
+    {
+        h ^= (unsigned char) *p++;
+        h *= 16777619u;
+    }
+    *len = p - s;
+    return h;
+}
+
+/* release - Free the chunks retired by intern_put */
+static void release(void)
+{
+    struct intern_chunk *c;
+
+    while ((c = retired) != NULL)
+    {
+        retired = c->next;
+        Free(c);
+    }
+}
+
+/* grow - Double the number of buckets */
+static void grow(void)
+{
+    unsigned i, n = nbuckets ? nbuckets * 2 : INTERN_BUCKETS;
+    struct intern_str **nb = Calloc(n, sizeof(struct intern_str *));
+    struct intern_str *e, *next;
+
+    for (i = 0; i < nbuckets; i++)
+    {
+        for (e = buckets[i]; e != NULL; e = next)
+        {
+            next = e->next;
+            e->next = nb[e->hash & (n - 1)];
+            nb[e->hash & (n - 1)] = e;
+        }
+    }
+    if (buckets != NULL)
+    {
+        Free(buckets);
+    }
+    buckets = nb;
+    nbuckets = n;
+}
+
+/*
+ * carve - Take size bytes from the current chunk, starting a new one if
+ * it is full. A string larger than a chunk gets a chunk of its own.
+ */
+static struct intern_str *carve(size_t size)
+{
+    struct intern_str *e;
+    size_t csize;
+
+    size = (size + INTERN_ALIGN - 1) & ~(size_t) (INTERN_ALIGN - 1);
+    if (current == NULL || current->used + size > current->size)
+    {
+        // The old chunk is freed when its last string is released
+        if (current != NULL && current->live == 0)
+        {
+            Free(current);
+        }
+        csize = size > INTERN_CHUNK ? size : INTERN_CHUNK;
+        current = Malloc(sizeof(struct intern_chunk) + csize);
+        current->next = NULL;
+        current->size = csize;
+        current->used = 0;
+        current->live = 0;
+    }
+    e = (struct intern_str *) (current->data + current->used);
+    current->used += size;
+    current->live++;
+    e->chunk = current;
+    arena_bytes += size;
+    return e;
+}
+
+/* intern_get - Return the shared copy of a string */
+const char *intern_get(const char *s)
+{
+    struct intern_str *e;
+    size_t len;
+    unsigned h = hash_str(s, &len);
+
+    release();
+    if (nbuckets == 0)
+    {
+        grow();
+    }
+    for (e = buckets[h & (nbuckets - 1)]; e != NULL; e = e->next)
+    {
+        if (e->hash == h && strcmp(e->text, s) == 0)
+        {
+            e->refs++;
+            return e->text;
+        }
+    }
+
+    if (nstrings >= nbuckets - nbuckets / 4)
+    {
+        grow();
+    }
+    e = carve(sizeof(struct intern_str) + len + 1);
+    memcpy(e->text, s, len + 1);
+    e->hash = h;
+    e->refs = 1;
+    e->next = buckets[h & (nbuckets - 1)];
+    buckets[h & (nbuckets - 1)] = e;
+    nstrings++;
+    return e->text;
+}
+
+/* intern_put - Drop a reference to an interned string */
+void intern_put(const char *s)
+{
+    struct intern_str *e = (struct intern_str *)
+        (s - offsetof(struct intern_str, text));
+    struct intern_str **pp;
+    struct intern_chunk *c = e->chunk;
+
+    if (--e->refs > 0)
+    {
+        return;
+    }
+    for (pp = &buckets[e->hash & (nbuckets - 1)]; *pp != e; pp = &(*pp)->next)
+    {
+        ;
+    }
+    *pp = e->next;
+    nstrings--;
+
+    if (--c->live > 0)
+    {
+        return;
+    }
+    arena_bytes -= c->used;
+    if (c == current)
+    {
+        // Nothing in it is referenced: start it over
+        c->used = 0;
+    }
+    else
+    {
+        c->next = retired;
+        retired = c;
+    }
+}
+
+/* intern_bytes - Bytes of arena memory in use */
+size_t intern_bytes(void)
+{
+    return arena_bytes;
+}
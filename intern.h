@@ -0,0 +1,40 @@
+/*
+ * intern.h: interned string storage for tshlab
+ *
+ * intern.h defines the store that holds the command lines of jobs. Each
+ * distinct string is kept once, in a chunked string arena, and shared by
+ * reference count: launching N copies of the same command costs one copy
+ * of its command line, and there is no length limit.
+ *
+ * Both are called as the job list changes, from the main program with
+ * the job signals blocked, and like the job list they must not be used
+ * from a signal handler. intern_put only retires the chunks that become
+ * empty; the next intern_get frees them.
+ */
+
+#ifndef __INTERN_H__
+#define __INTERN_H__
+
+#include <stddef.h>
+
+#define INTERN_CHUNK    65536   // size of an arena chunk
+
+/*
+ * intern_get returns the shared copy of the supplied string, taking a
+ * reference to it. Signals must be blocked.
+ */
+const char *intern_get(const char *s);
+
+/*
+ * intern_put drops a reference taken by intern_get. The string must not
+ * be used afterwards. Signals must be blocked.
+ */
+void intern_put(const char *s);
+
+/*
+ * intern_bytes returns the number of bytes of arena memory in use,
+ * headers included.
+ */
+size_t intern_bytes(void);
+
+#endif
@@ -0,0 +1,77 @@
+/* jobring.c
+ * job event ring for tshlab
+ */
+
+#include <signal.h>
+#include <stdatomic.h>
+#include "jobring.h"
+
+static struct job_event ring[JOBRING_SIZE];
+static atomic_uint head;                // Next event to pop (consumer)
+static atomic_uint tail;                // Next free entry (producer)
+static volatile sig_atomic_t overflow;  // Producer found the ring full
+
+/* jobring_full - Is the ring full? Records the overflow if so */
+bool jobring_full(void)
+{
+    unsigned t = atomic_load_explicit(&tail, memory_order_relaxed);
+    unsigned h = atomic_load_explicit(&head, memory_order_acquire);
+
+    if (t - h >= JOBRING_SIZE)
+    {
+        overflow = 1;
+        return true;
+    }
+    return false;
+}
+
+/* jobring_push - Queue a wait status */
+bool jobring_push(pid_t pid, int status)
+{
+    unsigned t = atomic_load_explicit(&tail, memory_order_relaxed);
+    struct job_event *ev;
+
+    if (jobring_full())
+    {
+        return false;
+    }
+    ev = &ring[t & (JOBRING_SIZE - 1)];
+    ev->pid = pid;
+    ev->status = status;
+    clock_gettime(CLOCK_MONOTONIC, &ev->when);
+    atomic_store_explicit(&tail, t + 1, memory_order_release);
+    return true;
+}
+
+/* jobring_pop - Take up to max events, oldest first */
+int jobring_pop(struct job_event *ev, int max)
+{
+    unsigned h = atomic_load_explicit(&head, memory_order_relaxed);
+    unsigned t = atomic_load_explicit(&tail, memory_order_acquire);
+    int n = 0;
+
+    while (h != t && n < max)
+    {
+        ev[n++] = ring[h & (JOBRING_SIZE - 1)];
+        h++;
+    }
+    atomic_store_explicit(&head, h, memory_order_release);
+    return n;
+}
+
+/* jobring_pending - Is there anything for the consumer to do? */
+bool jobring_pending(void)
+{
+    return overflow ||
+        atomic_load_explicit(&tail, memory_order_acquire) !=
+        atomic_load_explicit(&head, memory_order_relaxed);
+}
+
+/* jobring_overflowed - Test and clear the overflow flag */
+bool jobring_overflowed(void)
+{
+    bool was = overflow;
+
+    overflow = 0;
+    return was;
+}
@@ -0,0 +1,63 @@
+/*
+ * jobring.h: job event ring for tshlab
+ *
+ * jobring.h defines the queue between tsh's SIGCHLD handler and its main
+ * loop. The handler only reaps children and pushes one compact record
+ * per wait status; the main loop pops the records in batches and does
+ * the job list updates and the printing, outside signal context.
+ *
+ * There is a single producer (the handler, which SIGCHLD cannot
+ * interrupt) and a single consumer (the main loop), so the ring needs no
+ * lock: each side only advances its own index. When the ring is full the
+ * handler stops reaping and raises the overflow flag, and the consumer
+ * reaps the remaining children itself after draining.
+ */
+
+#ifndef __JOBRING_H__
+#define __JOBRING_H__
+
+#include <sys/types.h>
+#include <stdbool.h>
+#include <time.h>
+
+#define JOBRING_SIZE    256     // events in the ring (power of 2)
+
+struct job_event                // A wait status collected by the handler
+{
+    pid_t pid;                  // Process it belongs to
+    int status;                 // Wait status, as from waitpid
+    struct timespec when;       // When it was collected (CLOCK_MONOTONIC)
+};
+
+/*
+ * jobring_push queues a wait status. Async-signal-safe; to be called by
+ * the producer only. Returns false, and sets the overflow flag, if the
+ * ring is full.
+ */
+bool jobring_push(pid_t pid, int status);
+
+/*
+ * jobring_full returns true if there is no room for another event, and
+ * then sets the overflow flag. Async-signal-safe.
+ */
+bool jobring_full(void);
+
+/*
+ * jobring_pop moves up to max queued events into ev, oldest first, and
+ * returns how many were moved. To be called by the consumer only.
+ */
+int jobring_pop(struct job_event *ev, int max);
+
+/*
+ * jobring_pending returns true if there are events to pop, or children
+ * left unreaped by an overflow. Safe to call without blocking signals.
+ */
+bool jobring_pending(void);
+
+/*
+ * jobring_overflowed returns true if the producer ran out of room since
+ * the last call, and clears the flag.
+ */
+bool jobring_overflowed(void);
+
+#endif
@@ -0,0 +1,740 @@
+/* launch.c
+ * process launch engine for tshlab
+ *
+ * clone() needs _GNU_SOURCE, which conflicts with the
+ * declarations in csapp.h, so this file only uses the C library.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <signal.h>
+#include <spawn.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/pidfd.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include "launch.h"
+
+extern char **environ;          // Defined in libc
+
+launch_backend launch_mode = LAUNCH_FORK;   // Backend used by launch()
+
+// Signals the shell catches; a new job starts with their defaults
+static const int default_sigs[] = { SIGINT, SIGTSTP, SIGCHLD, SIGQUIT };
+#define NDEFAULT_SIGS (sizeof(default_sigs) / sizeof(default_sigs[0]))
+
+// Mode of files created by output redirection
+#define OUTFILE_MODE (S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP)
+
+// Buffer size requested for pipeline pipes
+#define PIPE_BUFSIZE (256 * 1024)
+
+// Stack the vfork child runs on until it execs
+#define VFORK_STACK 65536
+static char vfork_stack[VFORK_STACK] __attribute__((aligned(16)));
+
+// Shared between the shell and its vfork child
+struct vfork_arg
+{
+    const struct launch_spec *spec;
+    volatile int err;           // errno of the failed step, 0 on success
+};
+
+// Shell's end of the socketpair to the fork server, or -1
+static int server_fd = -1;
+
+struct server_request           // Header of a request to the fork server
+{
+    size_t len;                 // Bytes of strings following the header
+    int argc;                   // The strings are the path, argc arguments
+    int envc;                   // and envc environment entries
+    pid_t pgid;                 // Process group to join, 0 for a new one
+};                              // stdin and stdout ride along (SCM_RIGHTS)
+
+struct server_reply             // Answer of the fork server
+{
+    pid_t pid;                  // pid of the new job, or -1
+    int err;                    // errno when pid is -1
+};                              // The job's pidfd rides along if known
+
+static const char *backend_names[] = { "fork", "vfork", "spawn", "server" };
+
+/* launch_setbackend - Select the launch backend by name */
+bool launch_setbackend(const char *name)
+{
+    int i;
+
+    for (i = 0; i < sizeof(backend_names) / sizeof(backend_names[0]); i++)
+    {
+        if (strcmp(name, backend_names[i]) == 0)
+        {
+            launch_mode = (launch_backend) i;
+            return true;
+        }
+    }
+    return false;
+}
+
+/* launch_backendname - Return the name of a backend */
+const char *launch_backendname(launch_backend backend)
+{
+    return backend_names[backend];
+}
+
+/*
+ * setup_child - Move the new process into its process group, restore the
+ * default signal dispositions, clear the signal mask and apply the
+ * redirections. Returns 0 on success and an errno value on failure.
+ * Only async-signal-safe calls are made, because the vfork child runs
+ * in the shell's address space.
+ */
+static int setup_child(const struct launch_spec *spec)
+{
+    struct sigaction sa;
+    sigset_t empty;
+    int i, fd;
+
+    if (spec->pgid >= 0)
+    {
+        setpgid(0, spec->pgid);
+    }
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = SIG_DFL;
+    sigemptyset(&sa.sa_mask);
+    for (i = 0; i < NDEFAULT_SIGS; i++)
+    {
+        sigaction(default_sigs[i], &sa, NULL);
+    }
+    sigemptyset(&empty);
+    sigprocmask(SIG_SETMASK, &empty, NULL);
+
+    if (spec->infile != NULL)
+    {
+        if ((fd = open(spec->infile, O_RDONLY)) < 0)
+        {
+            return errno;
+        }
+        dup2(fd, STDIN_FILENO);
+        close(fd);
+    }
+    else if (spec->fd_in >= 0 && spec->fd_in != STDIN_FILENO)
+    {
+        dup2(spec->fd_in, STDIN_FILENO);
+    }
+    if (spec->outfile != NULL)
+    {
+        if ((fd = open(spec->outfile, O_WRONLY | O_TRUNC | O_CREAT,
+                       OUTFILE_MODE)) < 0)
+        {
+            return errno;
+        }
+        dup2(fd, STDOUT_FILENO);
+        close(fd);
+    }
+    else if (spec->fd_out >= 0 && spec->fd_out != STDOUT_FILENO)
+    {
+        dup2(spec->fd_out, STDOUT_FILENO);
+    }
+    return 0;
+}
+
+/* exec_child - Replace the child with the program; returns only on error */
+static int exec_child(const struct launch_spec *spec)
+{
+    char *const *envp = spec->envp ? spec->envp : environ;
+    const char *path = spec->path ? spec->path : spec->argv[0];
+
+    execve(path, spec->argv, envp);
+    return errno;
+}
+
+/*
+ * launch_fork - Start the job with a full fork(). The child cannot hand
+ * a failure back through memory, so it writes its errno to a
+ * close-on-exec pipe instead: the shell reads end of file once the exec
+ * has succeeded, and the errno if it failed. Either way the shell knows
+ * before it returns, as with the other backends.
+ */
+static pid_t launch_fork(const struct launch_spec *spec)
+{
+    int errpipe[2];
+    pid_t pid;
+    ssize_t n;
+    int err;
+
+    if (pipe2(errpipe, O_CLOEXEC) < 0)
+    {
+        return -1;
+    }
+    if ((pid = fork()) != 0)
+    {
+        close(errpipe[1]);
+        if (pid < 0)
+        {
+            err = errno;
+            close(errpipe[0]);
+            errno = err;
+            return -1;
+        }
+        // Also from the parent, so a later pipeline stage can join the
+        // group whichever process runs first
+        setpgid(pid, spec->pgid ? spec->pgid : pid);
+
+        do
+        {
+            n = read(errpipe[0], &err, sizeof(err));
+        } while (n < 0 && errno == EINTR);
+        close(errpipe[0]);
+        if (n == sizeof(err))
+        {
+            // The caller has SIGCHLD blocked, so the child is still ours
+            // to reap
+            waitpid(pid, NULL, 0);
+            errno = err;
+            return -1;
+        }
+        return pid;
+    }
+
+    close(errpipe[0]);
+    if ((err = setup_child(spec)) == 0)
+    {
+        err = exec_child(spec);
+    }
+    write(errpipe[1], &err, sizeof(err));
+    _exit(127);
+}
+
+/* vfork_child - Body of the vfork child, runs on vfork_stack */
+static int vfork_child(void *arg)
+{
+    struct vfork_arg *va = arg;
+
+    if ((va->err = setup_child(va->spec)) == 0)
+    {
+        va->err = exec_child(va->spec);
+    }
+    _exit(127);
+}
+
+/*
+ * clone_child - Start the job with clone(CLONE_VM | CLONE_VFORK) plus
+ * the supplied extra flags. The caller is suspended until the child
+ * execs or exits, so the child can hand a failure back through shared
+ * memory. Every signal is blocked around the clone so that none of the
+ * caller's handlers can run in the child before setup_child has reset
+ * them.
+ */
+static pid_t clone_child(const struct launch_spec *spec, int extra_flags,
+                         int *pidfd)
+{
+    struct vfork_arg va = { spec, 0 };
+    int flags = CLONE_VM | CLONE_VFORK | SIGCHLD | extra_flags;
+    sigset_t all, prev;
+    pid_t pid;
+    int fd = -1;
+    int saved;
+
+    sigfillset(&all);
+    sigprocmask(SIG_BLOCK, &all, &prev);
+    pid = clone(vfork_child, vfork_stack + VFORK_STACK,
+                flags | CLONE_PIDFD, &va, &fd);
+    if (pid < 0 && errno == EINVAL)
+    {
+        // Kernel without CLONE_PIDFD (before 5.2)
+        fd = -1;
+        pid = clone(vfork_child, vfork_stack + VFORK_STACK, flags, &va);
+    }
+    saved = errno;
+    sigprocmask(SIG_SETMASK, &prev, NULL);
+
+    if (pid < 0)
+    {
+        errno = saved;
+        return -1;
+    }
+    if (va.err != 0)
+    {
+        // A CLONE_PARENT child is reaped by our parent, not by us
+        if (!(extra_flags & CLONE_PARENT))
+        {
+            waitpid(pid, NULL, 0);
+        }
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+        errno = va.err;
+        return -1;
+    }
+    if (pidfd != NULL)
+    {
+        *pidfd = fd;
+    }
+    else if (fd >= 0)
+    {
+        close(fd);
+    }
+    return pid;
+}
+
+/* launch_vfork - Start the job with clone(CLONE_VM | CLONE_VFORK) */
+static pid_t launch_vfork(const struct launch_spec *spec, int *pidfd)
+{
+    return clone_child(spec, 0, pidfd);
+}
+
+/*
+ * launch_spawn - Start the job with posix_spawn. The process group,
+ * signal defaults, signal mask and redirections are all expressed as
+ * spawn attributes and file actions.
+ */
+static pid_t launch_spawn(const struct launch_spec *spec)
+{
+    posix_spawnattr_t attr;
+    posix_spawn_file_actions_t actions;
+    sigset_t defsigs, empty;
+    char *const *envp = spec->envp ? spec->envp : environ;
+    const char *path = spec->path ? spec->path : spec->argv[0];
+    pid_t pid;
+    int i, err;
+
+    posix_spawnattr_init(&attr);
+    posix_spawn_file_actions_init(&actions);
+
+    sigemptyset(&defsigs);
+    for (i = 0; i < NDEFAULT_SIGS; i++)
+    {
+        sigaddset(&defsigs, default_sigs[i]);
+    }
+    sigemptyset(&empty);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETPGROUP |
+                             POSIX_SPAWN_SETSIGDEF | POSIX_SPAWN_SETSIGMASK);
+    posix_spawnattr_setpgroup(&attr, spec->pgid);
+    posix_spawnattr_setsigdefault(&attr, &defsigs);
+    posix_spawnattr_setsigmask(&attr, &empty);
+
+    if (spec->infile != NULL)
+    {
+        posix_spawn_file_actions_addopen(&actions, STDIN_FILENO,
+                                         spec->infile, O_RDONLY, 0);
+    }
+    else if (spec->fd_in >= 0 && spec->fd_in != STDIN_FILENO)
+    {
+        posix_spawn_file_actions_adddup2(&actions, spec->fd_in, STDIN_FILENO);
+    }
+    if (spec->outfile != NULL)
+    {
+        posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO,
+                                         spec->outfile,
+                                         O_WRONLY | O_TRUNC | O_CREAT,
+                                         OUTFILE_MODE);
+    }
+    else if (spec->fd_out >= 0 && spec->fd_out != STDOUT_FILENO)
+    {
+        posix_spawn_file_actions_adddup2(&actions, spec->fd_out,
+                                         STDOUT_FILENO);
+    }
+
+    err = posix_spawn(&pid, path, &actions, &attr, spec->argv, envp);
+
+    posix_spawn_file_actions_destroy(&actions);
+    posix_spawnattr_destroy(&attr);
+
+    if (err != 0)
+    {
+        errno = err;
+        return -1;
+    }
+    return pid;
+}
+
+/*********************
+ * Fork server backend
+ *********************/
+
+/* io_full - read or write exactly len bytes; returns false on EOF/error */
+static bool io_full(int fd, void *buf, size_t len, bool writing)
+{
+    char *p = buf;
+    ssize_t n;
+
+    while (len > 0)
+    {
+        n = writing ? write(fd, p, len) : read(fd, p, len);
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            return false;
+        }
+        p += n;
+        len -= n;
+    }
+    return true;
+}
+
+/*
+ * send_fds - Send a fixed-size message with nfds descriptors attached.
+ * Returns false on error.
+ */
+static bool send_fds(int sock, const void *buf, size_t len,
+                     const int *fds, int nfds)
+{
+    char control[CMSG_SPACE(2 * sizeof(int))];
+    struct iovec iov = { (void *) buf, len };
+    struct msghdr msg;
+    struct cmsghdr *cmsg;
+    ssize_t n;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    if (nfds > 0)
+    {
+        memset(control, 0, sizeof(control));
+        msg.msg_control = control;
+        msg.msg_controllen = CMSG_SPACE(nfds * sizeof(int));
+        cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(nfds * sizeof(int));
+        memcpy(CMSG_DATA(cmsg), fds, nfds * sizeof(int));
+    }
+    do
+    {
+        n = sendmsg(sock, &msg, MSG_NOSIGNAL);
+    } while (n < 0 && errno == EINTR);
+    return n == (ssize_t) len;
+}
+
+/*
+ * recv_fds - Receive a fixed-size message and up to maxfds descriptors,
+ * which arrive close-on-exec. Returns the number of descriptors, or -1
+ * on EOF or error.
+ */
+static int recv_fds(int sock, void *buf, size_t len, int *fds, int maxfds)
+{
+    char control[CMSG_SPACE(2 * sizeof(int))];
+    struct iovec iov = { buf, len };
+    struct msghdr msg;
+    struct cmsghdr *cmsg;
+    ssize_t n;
+    int nfds = 0;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    do
+    {
+        n = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+    } while (n < 0 && errno == EINTR);
+    if (n <= 0)
+    {
+        return -1;
+    }
+
+    for (cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL;
+         cmsg = CMSG_NXTHDR(&msg, cmsg))
+    {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS)
+        {
+            nfds = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            if (nfds > maxfds)
+            {
+                nfds = maxfds;
+            }
+            memcpy(fds, CMSG_DATA(cmsg), nfds * sizeof(int));
+        }
+    }
+    // The rest of a fixed-size message follows on the stream
+    if (n < (ssize_t) len && !io_full(sock, (char *) buf + n, len - n, false))
+    {
+        return -1;
+    }
+    return nfds;
+}
+
+/*
+ * server_main - Loop of the fork server. Each request is unpacked into a
+ * launch_spec and started with a vfork-style clone that also carries
+ * CLONE_PARENT, making the job a child of the shell rather than of the
+ * server. Exits when the shell closes its end of the socket.
+ */
+static void server_main(int sock)
+{
+    struct server_request req;
+    struct server_reply reply;
+    struct launch_spec spec;
+    char *strings, *p, **vec;
+    int fds[2], nfds, pidfd, i;
+
+    for (;;)
+    {
+        if ((nfds = recv_fds(sock, &req, sizeof(req), fds, 2)) < 0)
+        {
+            _exit(0);
+        }
+        strings = malloc(req.len);
+        vec = malloc((req.argc + req.envc + 2) * sizeof(char *));
+        if (strings == NULL || vec == NULL ||
+            !io_full(sock, strings, req.len, false))
+        {
+            _exit(1);
+        }
+
+        p = strings;
+        memset(&spec, 0, sizeof(spec));
+        spec.path = p;
+        p += strlen(p) + 1;
+        for (i = 0; i < req.argc + req.envc; i++)
+        {
+            vec[i + (i >= req.argc)] = p;
+            p += strlen(p) + 1;
+        }
+        vec[req.argc] = NULL;
+        vec[req.argc + req.envc + 1] = NULL;
+        spec.argv = vec;
+        spec.envp = vec + req.argc + 1;
+        spec.fd_in = nfds > 0 ? fds[0] : -1;
+        spec.fd_out = nfds > 1 ? fds[1] : -1;
+        spec.pgid = req.pgid;
+
+        pidfd = -1;
+        reply.pid = clone_child(&spec, CLONE_PARENT, &pidfd);
+        reply.err = reply.pid < 0 ? errno : 0;
+        send_fds(sock, &reply, sizeof(reply), &pidfd, pidfd >= 0 ? 1 : 0);
+
+        for (i = 0; i < nfds; i++)
+        {
+            close(fds[i]);
+        }
+        if (pidfd >= 0)
+        {
+            close(pidfd);
+        }
+        free(strings);
+        free(vec);
+    }
+}
+
+/*
+ * start_server - Fork the fork server. It moves to its own process group
+ * so keyboard signals meant for jobs never reach it, and dies with the
+ * shell.
+ */
+static bool start_server(void)
+{
+    int sv[2];
+    pid_t pid;
+
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv) < 0)
+    {
+        return false;
+    }
+    if ((pid = fork()) < 0)
+    {
+        close(sv[0]);
+        close(sv[1]);
+        return false;
+    }
+    if (pid == 0)
+    {
+        close(sv[0]);
+        setpgid(0, 0);
+        prctl(PR_SET_PDEATHSIG, SIGKILL);
+        server_main(sv[1]);
+    }
+    close(sv[1]);
+    server_fd = sv[0];
+    return true;
+}
+
+/* open_redirect - Open a redirection file close-on-exec, or use fallback */
+static int open_redirect(const char *file, int flags, int fallback)
+{
+    if (file == NULL)
+    {
+        return fallback;
+    }
+    return open(file, flags | O_CLOEXEC, OUTFILE_MODE);
+}
+
+/*
+ * launch_server - Start the job through the fork server. Redirection
+ * files are opened here, so their errors are reported synchronously.
+ * If the server is gone, the job is started with the vfork backend.
+ */
+static pid_t launch_server(const struct launch_spec *spec, int *pidfd)
+{
+    char *const *envp = spec->envp ? spec->envp : environ;
+    const char *path = spec->path ? spec->path : spec->argv[0];
+    struct server_request req;
+    struct server_reply reply;
+    int fds[2], pfd = -1, i;
+    char *strings, *p;
+    size_t n;
+    bool ok;
+
+    // As in setup_child, the output is not created if the input fails
+    fds[0] = open_redirect(spec->infile, O_RDONLY,
+                           spec->fd_in >= 0 ? spec->fd_in : STDIN_FILENO);
+    if (fds[0] < 0)
+    {
+        return -1;
+    }
+    fds[1] = open_redirect(spec->outfile, O_WRONLY | O_TRUNC | O_CREAT,
+                           spec->fd_out >= 0 ? spec->fd_out : STDOUT_FILENO);
+    if (fds[1] < 0)
+    {
+        int saved = errno;
+        if (spec->infile != NULL)
+        {
+            close(fds[0]);
+        }
+        errno = saved;
+        return -1;
+    }
+
+    req.argc = 0;
+    req.envc = 0;
+    req.len = strlen(path) + 1;
+    for (i = 0; spec->argv[i] != NULL; i++, req.argc++)
+    {
+        req.len += strlen(spec->argv[i]) + 1;
+    }
+    for (i = 0; envp[i] != NULL; i++, req.envc++)
+    {
+        req.len += strlen(envp[i]) + 1;
+    }
+    req.pgid = spec->pgid;
+
+    strings = malloc(req.len);
+    ok = (strings != NULL);
+    if (ok)
+    {
+        p = strings;
+        n = strlen(path) + 1;
+        memcpy(p, path, n);
+        p += n;
+        for (i = 0; i < req.argc; i++, p += n)
+        {
+            n = strlen(spec->argv[i]) + 1;
+            memcpy(p, spec->argv[i], n);
+        }
+        for (i = 0; i < req.envc; i++, p += n)
+        {
+            n = strlen(envp[i]) + 1;
+            memcpy(p, envp[i], n);
+        }
+        ok = send_fds(server_fd, &req, sizeof(req), fds, 2) &&
+             io_full(server_fd, strings, req.len, true) &&
+             recv_fds(server_fd, &reply, sizeof(reply), &pfd, 1) >= 0;
+        free(strings);
+    }
+
+    if (spec->infile != NULL)
+    {
+        close(fds[0]);
+    }
+    if (spec->outfile != NULL)
+    {
+        close(fds[1]);
+    }
+
+    if (!ok)
+    {
+        // The server died: stop using it
+        close(server_fd);
+        server_fd = -1;
+        launch_mode = LAUNCH_VFORK;
+        return launch_vfork(spec, pidfd);
+    }
+    if (reply.pid < 0)
+    {
+        errno = reply.err;
+        return -1;
+    }
+    if (pidfd != NULL)
+    {
+        *pidfd = pfd;
+    }
+    else if (pfd >= 0)
+    {
+        close(pfd);
+    }
+    return reply.pid;
+}
+
+/* launch_pipe - Create a close-on-exec pipe between two pipeline stages */
+bool launch_pipe(int fds[2])
+{
+    if (pipe2(fds, O_CLOEXEC) < 0)
+    {
+        return false;
+    }
+    // A larger buffer lets the writer run ahead; failure is harmless
+    fcntl(fds[1], F_SETPIPE_SZ, PIPE_BUFSIZE);
+    return true;
+}
+
+/* launch_init - Prepare the selected backend */
+bool launch_init(void)
+{
+    if (launch_mode == LAUNCH_SERVER && server_fd < 0)
+    {
+        return start_server();
+    }
+    return true;
+}
+
+/* launch - Start the process described by spec */
+pid_t launch(const struct launch_spec *spec, int *pidfd)
+{
+    pid_t pid;
+
+    switch (launch_mode)
+    {
+    case LAUNCH_VFORK:
+        return launch_vfork(spec, pidfd);
+    case LAUNCH_SERVER:
+        return launch_server(spec, pidfd);
+    case LAUNCH_SPAWN:
+        pid = launch_spawn(spec);
+        break;
+    case LAUNCH_FORK:
+    default:
+        pid = launch_fork(spec);
+        break;
+    }
+
+    // The child cannot be reaped yet, so its pid cannot have been reused
+    if (pid > 0 && pidfd != NULL)
+    {
+        *pidfd = pidfd_open(pid, 0);
+    }
+    return pid;
+}
+
+/* launch_exec - Replace the shell itself with the program */
+int launch_exec(const struct launch_spec *spec)
+{
+    int err;
+
+    if ((err = setup_child(spec)) != 0)
+    {
+        return err;
+    }
+    return exec_child(spec);
+}
@@ -0,0 +1,113 @@
+/*
+ * launch.h: process launch engine for tshlab
+ *
+ * launch.h defines the interface tsh uses to start the process behind a
+ * job. The engine hides which system call actually creates the child:
+ *
+ *     fork    full fork(), then setup and execve in the child
+ *     vfork   clone(CLONE_VM | CLONE_VFORK): the child borrows the
+ *             shell's address space until it execs, so no page tables
+ *             are copied
+ *     spawn   posix_spawn() with the process group, signal defaults and
+ *             redirections expressed as spawn attributes/file actions
+ *     server  a fork server: a helper process forked when the shell
+ *             starts, before it has any state, receives the request
+ *             (argv, envp, process group, and the stdin/stdout
+ *             descriptors over SCM_RIGHTS) on a socketpair and starts
+ *             the job with clone(CLONE_PARENT | CLONE_VM | CLONE_VFORK),
+ *             so the job is still the shell's child and the launch
+ *             cost does not grow with the shell's address space
+ *
+ * Whatever the backend, the new process is placed in its own (or the
+ * requested) process group, has SIGINT, SIGTSTP, SIGCHLD and SIGQUIT
+ * restored to their default dispositions, runs with an empty signal
+ * mask, and has its stdin/stdout redirected as requested.
+ */
+
+#ifndef __LAUNCH_H__
+#define __LAUNCH_H__
+
+#include <sys/types.h>
+#include <stdbool.h>
+
+// Launch backends
+typedef enum launch_backend
+{
+    LAUNCH_FORK,
+    LAUNCH_VFORK,
+    LAUNCH_SPAWN,
+    LAUNCH_SERVER
+} launch_backend;
+
+struct launch_spec              // Describes one process to start
+{
+    const char *path;           // File to execute, argv[0] if NULL
+    char *const *argv;          // Arguments of the new program
+    char *const *envp;          // Environment of the new program
+    const char *infile;         // File to open as stdin, or NULL
+    const char *outfile;        // File to open as stdout, or NULL
+    int fd_in;                  // Else descriptor to use as stdin, or -1
+    int fd_out;                 // Else descriptor to use as stdout, or -1
+    pid_t pgid;                 // Process group to join, 0 for a new one
+                                // (-1 to stay put, for launch_exec)
+};
+
+// The backend used by launch(), LAUNCH_FORK unless changed.
+extern launch_backend launch_mode;
+
+/*
+ * launch_setbackend selects the backend by name ("fork", "vfork",
+ * "spawn" or "server"). Returns true on success, and false if the name
+ * is unknown.
+ */
+bool launch_setbackend(const char *name);
+
+/*
+ * launch_init prepares the selected backend; for the server backend it
+ * starts the fork server. It should be called once, as early as
+ * possible. Returns false if the backend could not be prepared.
+ */
+bool launch_init(void);
+
+/*
+ * launch_backendname returns the name of the supplied backend.
+ */
+const char *launch_backendname(launch_backend backend);
+
+/*
+ * launch_pipe creates a pipe to connect two stages of a pipeline. Both
+ * ends are close-on-exec, so a stage only inherits the ends it is given
+ * as fd_in/fd_out, and the buffer is enlarged so a fast writer blocks
+ * less often. Returns false and sets errno on failure.
+ */
+bool launch_pipe(int fds[2]);
+
+/*
+ * launch starts the process described by spec using the current backend
+ * and returns its process ID. On failure it returns -1 and sets errno.
+ * If pidfd is not NULL, it receives a close-on-exec pidfd referring to
+ * the child, or -1 if the kernel does not provide pidfds. The vfork
+ * backend gets it atomically from clone(CLONE_PIDFD); the others use
+ * pidfd_open() on the still unreaped child.
+ *
+ * Every backend knows whether the exec succeeded before it returns (the
+ * fork backend hears from its child over a close-on-exec pipe), so a
+ * failed exec or redirection is reported as -1 with the child's errno,
+ * and the child has already been reaped.
+ *
+ * The caller should have SIGCHLD blocked so the child cannot be reaped
+ * before it has been added to the job list.
+ */
+pid_t launch(const struct launch_spec *spec, int *pidfd);
+
+/*
+ * launch_exec replaces the calling process, the shell itself, with the
+ * program described by spec, after the same setup a child gets (pgid -1
+ * keeps the shell's process group). There is no process to wait for:
+ * tsh uses it for exec and for the last command of a script. It returns
+ * only on failure, with an errno value, when the shell may already have
+ * its signals and redirections set up for the program.
+ */
+int launch_exec(const struct launch_spec *spec);
+
+#endif
@@ -0,0 +1,149 @@
+/*
+ * mkbuiltins.c - Shell lab builtin table generator
+ *
+ * Reads builtins.def and writes builtin_table.h: the table of builtins
+ * indexed by a collision-free hash of their names. The table has the
+ * smallest power of 2 size for which a seed is found in MAXTRIES
+ * attempts.
+ *
+ * Usage: ./mkbuiltins builtins.def > builtin_table.h
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include "builtin.h"
+
+#define MAXBUILTINS 256         // Builtins in the .def file
+#define MAXFIELD    64          // Length of a name, handler or flags
+#define MAXTRIES    1000000     // Seeds tried per table size
+#define MAXSLOTS    (1 << 16)   // Largest table
+
+struct entry                    // A line of the .def file
+{
+    char name[MAXFIELD];
+    char handler[MAXFIELD];
+    char flags[MAXFIELD];
+};
+
+static struct entry entries[MAXBUILTINS];
+static int nentries;
+
+/* readdef - Read the .def file, exiting on malformed input */
+static void readdef(const char *path)
+{
+    char line[512];
+    int lineno = 0;
+    FILE *fp;
+
+    if ((fp = fopen(path, "r")) == NULL)
+    {
+        perror(path);
+        exit(1);
+    }
+    while (fgets(line, sizeof(line), fp) != NULL)
+    {
+        struct entry *e = &entries[nentries];
+        char extra;
+        int n;
+
+        lineno++;
+        line[strcspn(line, "#")] = '\0';
+        n = sscanf(line, "%63s %63s %63s %c", e->name, e->handler, e->flags,
+                   &extra);
+        if (n <= 0)
+        {
+            continue;
+        }
+        if (n != 3)
+        {
+            fprintf(stderr, "%s:%d: expected name, handler and flags\n",
+                    path, lineno);
+            exit(1);
+        }
+        for (int i = 0; i < nentries; i++)
+        {
+            if (strcmp(entries[i].name, e->name) == 0)
+            {
+                fprintf(stderr, "%s:%d: %s defined twice\n", path, lineno,
+                        e->name);
+                exit(1);
+            }
+        }
+        if (++nentries == MAXBUILTINS)
+        {
+            fprintf(stderr, "%s: too many builtins\n", path);
+            exit(1);
+        }
+    }
+    fclose(fp);
+}
+
+/* place - Try a seed; fills slot[] and returns true if nothing collides */
+static bool place(uint32_t seed, unsigned size, int *slot)
+{
+    static unsigned char used[MAXSLOTS];
+
+    memset(used, 0, size);
+    for (int i = 0; i < nentries; i++)
+    {
+        slot[i] = builtin_hash(entries[i].name, seed) & (size - 1);
+        if (used[slot[i]])
+        {
+            return false;
+        }
+        used[slot[i]] = 1;
+    }
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    int slot[MAXBUILTINS];
+    unsigned size = 1;
+    uint32_t seed;
+
+    if (argc != 2)
+    {
+        fprintf(stderr, "Usage: %s builtins.def\n", argv[0]);
+        exit(1);
+    }
+    readdef(argv[1]);
+    while (size < (unsigned) nentries)
+    {
+        size *= 2;
+    }
+    for (;;)
+    {
+        for (seed = 0; seed < MAXTRIES; seed++)
+        {
+            if (place(seed, size, slot))
+            {
+                break;
+            }
+        }
+        if (seed < MAXTRIES)
+        {
+            break;
+        }
+        if ((size *= 2) > MAXSLOTS)
+        {
+            fprintf(stderr, "%s: no collision-free seed found\n", argv[1]);
+            exit(1);
+        }
+    }
+
+    printf("/* builtin_table.h - generated by mkbuiltins from %s; "
+           "do not edit */\n\n", argv[1]);
+    printf("#define BUILTIN_SEED    %uu\n", seed);
+    printf("#define BUILTIN_SLOTS   %u\n\n", size);
+    printf("static const struct builtin builtin_table[BUILTIN_SLOTS] =\n{\n");
+    for (int i = 0; i < nentries; i++)
+    {
+        printf("    [%d] = { \"%s\", %s, %s },\n", slot[i], entries[i].name,
+               entries[i].handler, entries[i].flags);
+    }
+    printf("};\n");
+    exit(0);
+}
@@ -0,0 +1,214 @@
+/* parsecache.c
+ * parsed command cache for tshlab
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include "parsecache.h"
+
+#define PCACHE_BUCKETS  (2 * PCACHE_ENTRIES)    // hash buckets (power of 2)
+
+struct pcache_entry             // A cached line and its parse
+{
+    uint64_t hash;              // Hash of the line
+    size_t len;                 // Length of the line
+    short chain;                // Next entry in the bucket + 1, 0 at the end
+    short prev;                 // More recently used entry, -1 if none
+    short next;                 // Less recently used entry, -1 if none
+    parseline_return result;    // What parseline returned
+    struct cmdline_tokens token;    // The parse, pointing into text/argv
+    char *argv[PCACHE_ARGS];    // token.argv
+    char line[PCACHE_LINE];     // The line
+    char text[PCACHE_LINE + 1]; // token.text: the line cut into words
+};
+
+static struct pcache_entry entries[PCACHE_ENTRIES];
+static short buckets[PCACHE_BUCKETS];   // First entry + 1, 0 if none
+static short mru = -1;          // Most recently used entry
+static short lru = -1;          // Least recently used entry
+static struct pcache_stats stats;
+
+/* hash_line - Hash a line 8 bytes at a time */
+static uint64_t hash_line(const char *s, size_t len)
+{
+    uint64_t h = len * 0x9e3779b97f4a7c15ull;
+    uint64_t w;
+
+    for (; len >= 8; s += 8, len -= 8)
+    {
+        memcpy(&w, s, 8);
+        h = (h ^ w) * 0xff51afd7ed558ccdull;
+        h ^= h >> 29;
+    }
+    if (len > 0)
+    {
+        w = 0;
+        memcpy(&w, s, len);
+        h = (h ^ w) * 0xff51afd7ed558ccdull;
+        h ^= h >> 29;
+    }
+    return h ^ (h >> 32);
+}
+
+/* lru_unlink - Take an entry off the LRU list */
+static void lru_unlink(int i)
+{
+    struct pcache_entry *e = &entries[i];
+
+    if (e->prev >= 0)
+    {
+        entries[e->prev].next = e->next;
+    }
+    else
+    {
+        mru = e->next;
+    }
+    if (e->next >= 0)
+    {
+        entries[e->next].prev = e->prev;
+    }
+    else
+    {
+        lru = e->prev;
+    }
+}
+
+/* lru_push - Make an entry the most recently used */
+static void lru_push(int i)
+{
+    struct pcache_entry *e = &entries[i];
+
+    e->prev = -1;
+    e->next = mru;
+    if (mru >= 0)
+    {
+        entries[mru].prev = i;
+    }
+    mru = i;
+    if (lru < 0)
+    {
+        lru = i;
+    }
+}
+
+/* bucket_unlink - Take an entry out of its hash bucket */
+static void bucket_unlink(int i)
+{
+    short *link = &buckets[entries[i].hash & (PCACHE_BUCKETS - 1)];
+
+    while (*link != i + 1)
+    {
+        link = &entries[*link - 1].chain;
+    }
+    *link = entries[i].chain;
+}
+
+/* pcache_get - Look up the parse of a line */
+bool pcache_get(const char *cmdline, size_t len,
+                struct cmdline_tokens *token, parseline_return *result)
+{
+    uint64_t h = hash_line(cmdline, len);
+    struct pcache_entry *e;
+    int i;
+
+    for (i = buckets[h & (PCACHE_BUCKETS - 1)] - 1; i >= 0; i = e->chain - 1)
+    {
+        e = &entries[i];
+        if (e->hash == h && e->len == len &&
+            memcmp(e->line, cmdline, len) == 0)
+        {
+            if (mru != i)
+            {
+                lru_unlink(i);
+                lru_push(i);
+            }
+            *token = e->token;
+            *result = e->result;
+            stats.hits++;
+            return true;
+        }
+    }
+    stats.misses++;
+    return false;
+}
+
+/* pcache_put - Cache the parse of a line */
+void pcache_put(const char *cmdline, size_t len,
+                const struct cmdline_tokens *token, parseline_return result)
+{
+    struct pcache_entry *e;
+    int i, nslots;
+    short *bucket;
+
+    if (len > PCACHE_LINE)
+    {
+        return;
+    }
+    // argv runs to the NULL that ends the last stage
+    nslots = token->stage[token->nstages - 1];
+    while (token->argv[nslots] != NULL)
+    {
+        nslots++;
+    }
+    if (++nslots > PCACHE_ARGS)
+    {
+        return;
+    }
+
+    // Take a free entry, or the least recently used one
+    if (stats.entries < PCACHE_ENTRIES)
+    {
+        i = stats.entries++;
+    }
+    else
+    {
+        i = lru;
+        lru_unlink(i);
+        bucket_unlink(i);
+        stats.evictions++;
+    }
+    e = &entries[i];
+
+    e->hash = hash_line(cmdline, len);
+    e->len = len;
+    e->result = result;
+    memcpy(e->line, cmdline, len);
+    memcpy(e->text, token->text, len + 1);
+
+    // Move the pointers of the parse from its text to ours
+    e->token = *token;
+    e->token.text = e->text;
+    e->token.argv = e->argv;
+    for (int j = 0; j < nslots; j++)
+    {
+        e->argv[j] = token->argv[j] == NULL ? NULL :
+                     e->text + (token->argv[j] - token->text);
+    }
+    if (token->infile != NULL)
+    {
+        e->token.infile = e->text + (token->infile - token->text);
+    }
+    if (token->outfile != NULL)
+    {
+        e->token.outfile = e->text + (token->outfile - token->text);
+    }
+
+    bucket = &buckets[e->hash & (PCACHE_BUCKETS - 1)];
+    e->chain = *bucket;
+    *bucket = i + 1;
+    lru_push(i);
+}
+
+/* pcache_clear - Forget every line and zero the counters */
+void pcache_clear(void)
+{
+    memset(buckets, 0, sizeof(buckets));
+    memset(&stats, 0, sizeof(stats));
+    mru = lru = -1;
+}
+
+/* pcache_getstats - Report the counters */
+struct pcache_stats pcache_getstats(void)
+{
+    return stats;
+}
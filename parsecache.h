@@ -0,0 +1,65 @@
+/*
+ * parsecache.h: parsed command cache for tshlab
+ *
+ * parsecache.h defines the cache eval consults before parseline. It
+ * maps a command line to the cmdline_tokens parseline made of it, so
+ * a line that a script or a loop runs over and over is tokenized once.
+ * Entries are found through a hash of the raw line and confirmed by
+ * comparing the whole line; the least recently used entry makes room
+ * for a new one.
+ *
+ * Only lines that parse to a job or builtin (PARSELINE_FG or
+ * PARSELINE_BG) are cached: an error has to be printed each time, and
+ * an empty line costs nothing to parse. Lines longer than PCACHE_LINE
+ * bytes or with more than PCACHE_ARGS argv slots are not cached either;
+ * their parse is cheap next to everything else they cost.
+ *
+ * The tokens handed out on a hit point into the cache entry, which stays
+ * valid until the next pcache_put or pcache_clear. They must not be
+ * modified.
+ */
+
+#ifndef __PARSECACHE_H__
+#define __PARSECACHE_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "tsh_helper.h"
+
+#define PCACHE_ENTRIES  64      // lines cached
+#define PCACHE_LINE     256     // longest line cached, in bytes
+#define PCACHE_ARGS     32      // most argv slots (NULLs included) cached
+
+struct pcache_stats             // What the cache has done
+{
+    unsigned long hits;         // Lines found
+    unsigned long misses;       // Lines not found
+    unsigned long evictions;    // Entries dropped to make room
+    int entries;                // Entries in use
+};
+
+/*
+ * pcache_get looks up the line of len bytes. On a hit it fills in token
+ * and *result as parseline did for the line, and returns true.
+ */
+bool pcache_get(const char *cmdline, size_t len,
+                struct cmdline_tokens *token, parseline_return *result);
+
+/*
+ * pcache_put records the parse of the line of len bytes, if it can be
+ * cached.
+ */
+void pcache_put(const char *cmdline, size_t len,
+                const struct cmdline_tokens *token, parseline_return result);
+
+/*
+ * pcache_clear drops every entry and zeroes the counters.
+ */
+void pcache_clear(void);
+
+/*
+ * pcache_getstats returns the counters.
+ */
+struct pcache_stats pcache_getstats(void);
+
+#endif
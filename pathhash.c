@@ -0,0 +1,347 @@
+/* pathhash.c
+ * command path resolution cache for tshlab
+ */
+
+#include "csapp.h"
+#include "pathhash.h"
+
+#define PATH_BUCKETS    64      // initial number of hash buckets
+
+struct path_entry               // A remembered command
+{
+    char *name;                 // Command name as typed
+    char *path;                 // File to execute, NULL if not found
+    unsigned hash;              // Hash of name
+    unsigned long hits;         // Times the command was resolved
+    struct path_entry *next;    // Next entry in the bucket
+};
+
+struct path_dir                 // A directory of PATH
+{
+    char *dir;                  // Directory name ("." for empty entries)
+    struct timespec mtime;      // Modification time when last checked
+};
+
+static struct path_entry **buckets; // The hash table
+static unsigned nbuckets;           // Number of buckets (power of 2)
+static unsigned nentries;           // Number of remembered commands
+
+static char *path_value;            // PATH the table was built for
+static struct path_dir *dirs;       // Directories of path_value
+static int ndirs;                   // Number of directories
+static long last_check_ms;          // When the mtimes were last checked
+static bool path_dirty = true;     // PATH may differ from path_value
+
+/* hash_name - FNV-1a hash of a command name */
+static unsigned hash_name(const char *name)
+{
+    unsigned h = 2166136261u;
+
+    while (*name != '\0')
+    {
+        h ^= (unsigned char) *name++;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+/* now_ms - Milliseconds from a monotonic clock (no system call, vDSO) */
+static long now_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000L + ts.tv_nsec / 1000000L;
+}
+
+/* dir_mtime - Modification time of a directory, zero if it is missing */
+static struct timespec dir_mtime(const char *dir)
+{
+    struct stat sb;
+    struct timespec zero = { 0, 0 };
+
+    if (stat(dir, &sb) < 0)
+    {
+        return zero;
+    }
+    return sb.st_mtim;
+}
+
+/* free_dirs - Forget the split PATH */
+static void free_dirs(void)
+{
+    int i;
+
+    for (i = 0; i < ndirs; i++)
+    {
+        Free(dirs[i].dir);
+    }
+    Free(dirs);
+    Free(path_value);
+    dirs = NULL;
+    ndirs = 0;
+    path_value = NULL;
+}
+
+/* split_path - Split PATH into its directories and record their mtimes */
+static void split_path(const char *path)
+{
+    const char *p, *end;
+    int n = 1;
+
+    for (p = path; *p != '\0'; p++)
+    {
+        if (*p == ':')
+        {
+            n++;
+        }
+    }
+
+    path_value = strdup(path);
+    dirs = Malloc(n * sizeof(struct path_dir));
+    ndirs = 0;
+    for (p = path; ; p = end + 1)
+    {
+        end = strchr(p, ':');
+        if (end == NULL)
+        {
+            end = p + strlen(p);
+        }
+        if (end == p)
+        {
+            dirs[ndirs].dir = strdup(".");
+        }
+        else
+        {
+            dirs[ndirs].dir = strndup(p, end - p);
+        }
+        dirs[ndirs].mtime = dir_mtime(dirs[ndirs].dir);
+        ndirs++;
+        if (*end == '\0')
+        {
+            break;
+        }
+    }
+    last_check_ms = now_ms();
+}
+
+/* path_clear - Forget every remembered command */
+void path_clear(void)
+{
+    unsigned i;
+    struct path_entry *e, *next;
+
+    for (i = 0; i < nbuckets; i++)
+    {
+        for (e = buckets[i]; e != NULL; e = next)
+        {
+            next = e->next;
+            Free(e->name);
+            Free(e->path);
+            Free(e);
+        }
+        buckets[i] = NULL;
+    }
+    nentries = 0;
+}
+
+/*
+ * validate - Flush the table if PATH changed, or if one of its
+ * directories was modified since the last check
+ */
+static void validate(void)
+{
+    const char *path;
+    bool stale = false;
+    long now;
+    int i;
+
+    // Only the shell changes its environment, and it says when
+    if (path_dirty)
+    {
+        path_dirty = false;
+        if ((path = getenv("PATH")) == NULL)
+        {
+            path = PATH_DEFAULT;
+        }
+        if (path_value == NULL || strcmp(path, path_value) != 0)
+        {
+            free_dirs();
+            split_path(path);
+            path_clear();
+            return;
+        }
+    }
+
+    now = now_ms();
+    if (now - last_check_ms < PATH_RECHECK_MS)
+    {
+        return;
+    }
+    last_check_ms = now;
+    for (i = 0; i < ndirs; i++)
+    {
+        struct timespec mtime = dir_mtime(dirs[i].dir);
+        if (mtime.tv_sec != dirs[i].mtime.tv_sec ||
+            mtime.tv_nsec != dirs[i].mtime.tv_nsec)
+        {
+            dirs[i].mtime = mtime;
+            stale = true;
+        }
+    }
+    if (stale)
+    {
+        path_clear();
+    }
+}
+
+/* search - Search the PATH directories for an executable file */
+static char *search(const char *name)
+{
+    struct stat sb;
+    size_t len = strlen(name);
+    char *buf;
+    int i;
+
+    for (i = 0; i < ndirs; i++)
+    {
+        size_t dlen = strlen(dirs[i].dir);
+        buf = Malloc(dlen + len + 2);
+        memcpy(buf, dirs[i].dir, dlen);
+        buf[dlen] = '/';
+        memcpy(buf + dlen + 1, name, len + 1);
+        if (stat(buf, &sb) == 0 && S_ISREG(sb.st_mode) &&
+            access(buf, X_OK) == 0)
+        {
+            return buf;
+        }
+        Free(buf);
+    }
+    return NULL;
+}
+
+/* grow - Double the number of buckets */
+static void grow(void)
+{
+    unsigned i, n = nbuckets ? nbuckets * 2 : PATH_BUCKETS;
+    struct path_entry **nb = Calloc(n, sizeof(struct path_entry *));
+    struct path_entry *e, *next;
+
+    for (i = 0; i < nbuckets; i++)
+    {
+        for (e = buckets[i]; e != NULL; e = next)
+        {
+            next = e->next;
+            e->next = nb[e->hash & (n - 1)];
+            nb[e->hash & (n - 1)] = e;
+        }
+    }
+    if (buckets != NULL)
+    {
+        Free(buckets);
+    }
+    buckets = nb;
+    nbuckets = n;
+}
+
+/* lookup - Find or create the entry of a bare command name */
+static struct path_entry *lookup(const char *name)
+{
+    unsigned h = hash_name(name);
+    struct path_entry *e;
+
+    validate();
+    if (nbuckets == 0)
+    {
+        grow();
+    }
+    for (e = buckets[h & (nbuckets - 1)]; e != NULL; e = e->next)
+    {
+        if (e->hash == h && strcmp(e->name, name) == 0)
+        {
+            return e;
+        }
+    }
+
+    if (nentries >= nbuckets - nbuckets / 4)
+    {
+        grow();
+    }
+    e = Malloc(sizeof(struct path_entry));
+    e->name = strdup(name);
+    e->path = search(name);
+    e->hash = h;
+    e->hits = 0;
+    e->next = buckets[h & (nbuckets - 1)];
+    buckets[h & (nbuckets - 1)] = e;
+    nentries++;
+    return e;
+}
+
+/* path_resolve - Return the file to execute for a command name */
+const char *path_resolve(const char *name)
+{
+    struct path_entry *e;
+
+    if (strchr(name, '/') != NULL)
+    {
+        return name;
+    }
+    if (*name == '\0')
+    {
+        return NULL;
+    }
+    e = lookup(name);
+    e->hits++;
+    return e->path;
+}
+
+/* path_changed - Note that PATH may have been set or unset */
+void path_changed(void)
+{
+    path_dirty = true;
+}
+
+/* path_remember - Resolve a command name without counting a use */
+bool path_remember(const char *name)
+{
+    if (strchr(name, '/') != NULL || *name == '\0')
+    {
+        return false;
+    }
+    return lookup(name)->path != NULL;
+}
+
+/* path_list - Print the remembered commands, as the hash builtin */
+void path_list(int output_fd)
+{
+    unsigned i;
+    struct path_entry *e;
+    char buf[MAXLINE];
+    bool empty = true;
+
+    for (i = 0; i < nbuckets; i++)
+    {
+        for (e = buckets[i]; e != NULL; e = e->next)
+        {
+            // Failed searches are remembered but not listed
+            if (e->path == NULL)
+            {
+                continue;
+            }
+            if (empty)
+            {
+                sprintf(buf, "hits\tcommand\n");
+                Rio_writen(output_fd, buf, strlen(buf));
+                empty = false;
+            }
+            snprintf(buf, MAXLINE, "%4lu\t%s\n", e->hits, e->path);
+            Rio_writen(output_fd, buf, strlen(buf));
+        }
+    }
+    if (empty)
+    {
+        sprintf(buf, "hash: hash table empty\n");
+        Rio_writen(output_fd, buf, strlen(buf));
+    }
+}
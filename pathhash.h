@@ -0,0 +1,56 @@
+/*
+ * pathhash.h: command path resolution cache for tshlab
+ *
+ * pathhash.h defines the resolver tsh uses to turn a command name into
+ * the file it executes. Names that contain a '/' are used as they are.
+ * Bare names are searched for in the directories of PATH, and the
+ * result is remembered in a hash table, including failed searches, so
+ * a command that runs over and over costs a single table lookup.
+ *
+ * The table is flushed when PATH changes (tsh calls path_changed when
+ * it sets or unsets PATH). The modification times of
+ * the PATH directories are checked at most once per PATH_RECHECK_MS, so
+ * a program installed into (or removed from) one of them is noticed
+ * without a stat() on every lookup.
+ */
+
+#ifndef __PATHHASH_H__
+#define __PATHHASH_H__
+
+#include <stdbool.h>
+
+#define PATH_RECHECK_MS 1000    // min interval between PATH mtime checks
+#define PATH_DEFAULT    "/bin:/usr/bin" // search path when PATH is unset
+
+/*
+ * path_resolve returns the file to execute for the supplied command
+ * name, or NULL if it cannot be found in PATH. The returned string is
+ * owned by the cache and stays valid until the next call that changes
+ * the cache.
+ */
+const char *path_resolve(const char *name);
+
+/*
+ * path_remember resolves the supplied command name and records the
+ * result without counting it as a use. Returns true if it was found.
+ */
+bool path_remember(const char *name);
+
+/*
+ * path_changed tells the cache that PATH may have changed, so it is
+ * compared with the PATH the cache was built for at the next lookup.
+ */
+void path_changed(void);
+
+/*
+ * path_clear forgets every remembered command.
+ */
+void path_clear(void);
+
+/*
+ * path_list writes the remembered commands with their hit counts to the
+ * supplied file descriptor, in the format of the hash builtin.
+ */
+void path_list(int output_fd);
+
+#endif
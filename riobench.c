@@ -0,0 +1,152 @@
+/*
+ * riobench.c - Shell lab buffered line reader benchmark
+ *
+ * Measures the throughput of the RIO line readers on a file of text
+ * lines of a given length: the byte-at-a-time rio_readlineb that
+ * csapp.c used before, the memchr-based rio_readlineb that replaced
+ * it, and rio_borrowlineb, which hands lines out in place. The file is
+ * read from the page cache, so the figures are the cost of the readers
+ * and their read() calls.
+ *
+ * Usage: ./riobench [-s file_mb] [-l line_len]
+ */
+
+#include <time.h>
+#include "csapp.h"
+
+/* Time in seconds from a monotonic clock */
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* The rio_read of the old line reader, refilling a fixed buffer */
+static ssize_t byte_read(rio_t *rp, char *usrbuf, size_t n)
+{
+    int cnt;
+
+    while (rp->rio_cnt <= 0) {
+	rp->rio_cnt = read(rp->rio_fd, rp->rio_buf, sizeof(rp->rio_buf));
+	if (rp->rio_cnt < 0) {
+	    if (errno != EINTR)
+		return -1;
+	}
+	else if (rp->rio_cnt == 0)
+	    return 0;
+	else
+	    rp->rio_bufptr = rp->rio_buf;
+    }
+    cnt = n;
+    if (rp->rio_cnt < n)
+	cnt = rp->rio_cnt;
+    memcpy(usrbuf, rp->rio_bufptr, cnt);
+    rp->rio_bufptr += cnt;
+    rp->rio_cnt -= cnt;
+    return cnt;
+}
+
+/* The old rio_readlineb, one byte_read per byte */
+static ssize_t byte_readlineb(rio_t *rp, void *usrbuf, size_t maxlen)
+{
+    int n, rc;
+    char c, *bufp = usrbuf;
+
+    for (n = 1; n < maxlen; n++) {
+	if ((rc = byte_read(rp, &c, 1)) == 1) {
+	    *bufp++ = c;
+	    if (c == '\n') {
+		n++;
+		break;
+	    }
+	} else if (rc == 0) {
+	    if (n == 1)
+		return 0;
+	    else
+		break;
+	} else
+	    return -1;
+    }
+    *bufp = 0;
+    return n-1;
+}
+
+/* Read the whole file at fd with reader impl, and print a result row */
+static void run(const char *impl, int fd, size_t size)
+{
+    static char line[MAXLINE];
+    double start, elapsed;
+    long nlines = 0;
+    char *p;
+    ssize_t n;
+    rio_t rio;
+
+    Lseek(fd, 0, SEEK_SET);
+    Rio_readinitb(&rio, fd);
+    start = now();
+    for (;;) {
+	if (strcmp(impl, "byte") == 0)
+	    n = byte_readlineb(&rio, line, MAXLINE);
+	else if (strcmp(impl, "memchr") == 0)
+	    n = rio_readlineb(&rio, line, MAXLINE);
+	else
+	    n = rio_borrowlineb(&rio, &p);
+	if (n <= 0)
+	    break;
+	nlines++;
+    }
+    elapsed = now() - start;
+    if (n < 0)
+	unix_error("read error");
+    rio_freeb(&rio);
+    printf("%-8s %12.1f %12.1f %12ld\n", impl, elapsed * 1e9 / nlines,
+	   size / elapsed / 1e6, nlines);
+}
+
+int main(int argc, char **argv)
+{
+    static char chunk[1 << 16];
+    char path[] = "/tmp/riobenchXXXXXX";
+    int c, fd;
+    size_t mb = 64, len = 80, size = 0, n, i;
+
+    while ((c = getopt(argc, argv, "s:l:")) != EOF) {
+	switch (c) {
+	case 's':
+	    mb = atoi(optarg);
+	    break;
+	case 'l':
+	    len = atoi(optarg);
+	    break;
+	default:
+	    fprintf(stderr, "Usage: %s [-s file_mb] [-l line_len]\n", argv[0]);
+	    exit(1);
+	}
+    }
+    if (len < 1 || len >= MAXLINE) {
+	fprintf(stderr, "line_len must be between 1 and %d\n", MAXLINE - 1);
+	exit(1);
+    }
+
+    /* A file of mb megabytes of lines of len bytes, newline included */
+    if ((fd = mkstemp(path)) < 0)
+	unix_error("mkstemp error");
+    unlink(path);
+    n = sizeof(chunk) / len * len;
+    for (i = 0; i < n; i++)
+	chunk[i] = i % len == len - 1 ? '\n' : 'a' + i % len % 26;
+    while (size < mb << 20) {
+	Rio_writen(fd, chunk, n);
+	size += n;
+    }
+
+    printf("%zu MB in lines of %zu bytes\n", size >> 20, len);
+    printf("%-8s %12s %12s %12s\n", "impl", "ns/line", "MB/s", "lines");
+    run("byte", fd, size);
+    run("memchr", fd, size);
+    run("borrow", fd, size);
+    Close(fd);
+    exit(0);
+}
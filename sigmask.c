@@ -0,0 +1,84 @@
+/* sigmask.c
+ * cached signal mask for tshlab
+ *
+ * sigorset and friends need _GNU_SOURCE, so like launch.c this file
+ * does not include csapp.h.
+ */
+
+#define _GNU_SOURCE
+#include <string.h>
+#include "sigmask.h"
+
+static sigset_t current;        // The mask, as last set or read
+static bool known;              // current is valid
+
+/* load - Read the mask from the kernel the first time it is needed */
+static void load(void)
+{
+    if (!known)
+    {
+        sigprocmask(SIG_SETMASK, NULL, &current);
+        known = true;
+    }
+}
+
+/* install - Make want the mask, calling the kernel only if it differs */
+static int install(const sigset_t *want)
+{
+    if (memcmp(want, &current, sizeof(sigset_t)) == 0)
+    {
+        return 0;
+    }
+    if (sigprocmask(SIG_SETMASK, want, NULL) < 0)
+    {
+        return -1;
+    }
+    current = *want;
+    return 0;
+}
+
+/* sigmask_block - Add signals to the mask */
+int sigmask_block(const sigset_t *set)
+{
+    sigset_t want;
+
+    load();
+    sigorset(&want, &current, set);
+    return install(&want);
+}
+
+/* sigmask_unblock - Remove signals from the mask */
+int sigmask_unblock(const sigset_t *set)
+{
+    sigset_t want;
+    int sig;
+
+    load();
+    want = current;
+    for (sig = 1; sig < NSIG; sig++)
+    {
+        if (sigismember(set, sig) == 1)
+        {
+            sigdelset(&want, sig);
+        }
+    }
+    return install(&want);
+}
+
+/* sigmask_suspend - Wait for a signal with some signals unblocked */
+void sigmask_suspend(const sigset_t *set)
+{
+    sigset_t during;
+    int sig;
+
+    load();
+    during = current;
+    for (sig = 1; sig < NSIG; sig++)
+    {
+        if (sigismember(set, sig) == 1)
+        {
+            sigdelset(&during, sig);
+        }
+    }
+    sigsuspend(&during);
+}
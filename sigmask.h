@@ -0,0 +1,40 @@
+/*
+ * sigmask.h: cached signal mask for tshlab
+ *
+ * sigmask.h defines the critical-section layer tsh uses to block and
+ * unblock signals. The current mask of the main program is kept in
+ * userspace, and the kernel is only asked to change it when a call
+ * actually changes it, so nested or repeated blocks cost nothing.
+ *
+ * The cache describes the main program only. A signal handler runs
+ * with a mask the kernel set up, and gets the main program's mask back
+ * when it returns, so handlers must not use this layer; they should
+ * rely on the sa_mask they were installed with.
+ */
+
+#ifndef __SIGMASK_H__
+#define __SIGMASK_H__
+
+#include <signal.h>
+#include <stdbool.h>
+
+/*
+ * sigmask_block adds the signals in set to the mask.
+ * Returns 0 on success, and -1 (with errno set) on failure.
+ */
+int sigmask_block(const sigset_t *set);
+
+/*
+ * sigmask_unblock removes the signals in set from the mask.
+ * Returns 0 on success, and -1 (with errno set) on failure.
+ */
+int sigmask_unblock(const sigset_t *set);
+
+/*
+ * sigmask_suspend waits for a signal with the signals in set removed
+ * from the mask, as sigsuspend does, and returns once a handler has
+ * run, with the mask as it was.
+ */
+void sigmask_suspend(const sigset_t *set);
+
+#endif
@@ -0,0 +1,87 @@
+/*
+ * spawnbench.c - Shell lab launch benchmark
+ *
+ * Measures the latency of starting a job through each backend of the
+ * launch engine (fork, vfork, spawn, server). Every iteration launches the
+ * program in a new process group, exactly as tsh does, and reaps it.
+ *
+ * Because the cost of fork() grows with the size of the parent, the
+ * benchmark can first grow its own heap to imitate a large shell.
+ *
+ * Usage: ./spawnbench [-n iters] [-m heap_mb] [program]
+ */
+
+#include <time.h>
+#include "csapp.h"
+#include "launch.h"
+
+/* Time in seconds from a monotonic clock */
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char **argv)
+{
+    int c, i, iters = 2000;
+    size_t heap_mb = 0;
+    char *prog = "/bin/true";
+    char *child_argv[2];
+    struct launch_spec spec;
+    launch_backend backend;
+    double start, elapsed;
+    pid_t pid;
+
+    while ((c = getopt(argc, argv, "n:m:")) != EOF) {
+	switch (c) {
+	case 'n':
+	    iters = atoi(optarg);
+	    break;
+	case 'm':
+	    heap_mb = atoi(optarg);
+	    break;
+	default:
+	    fprintf(stderr, "Usage: %s [-n iters] [-m heap_mb] [program]\n",
+		    argv[0]);
+	    exit(1);
+	}
+    }
+    if (optind < argc)
+	prog = argv[optind];
+
+    /* Start the fork server while we are still small, like tsh does */
+    launch_mode = LAUNCH_SERVER;
+    if (!launch_init())
+	unix_error("launch_init error");
+
+    /* Touch every page so the heap is really mapped in the parent */
+    if (heap_mb > 0)
+	memset(Malloc(heap_mb << 20), 1, heap_mb << 20);
+
+    child_argv[0] = prog;
+    child_argv[1] = NULL;
+    memset(&spec, 0, sizeof(spec));
+    spec.argv = child_argv;
+    spec.envp = environ;
+    spec.fd_in = -1;
+    spec.fd_out = -1;
+
+    printf("%d launches of %s, %zu MB extra heap\n", iters, prog, heap_mb);
+    printf("%-8s %12s %12s\n", "backend", "usec/job", "jobs/sec");
+    for (backend = LAUNCH_FORK; backend <= LAUNCH_SERVER; backend++) {
+	launch_mode = backend;
+	start = now();
+	for (i = 0; i < iters; i++) {
+	    if ((pid = launch(&spec, NULL)) < 0)
+		unix_error("launch error");
+	    Waitpid(pid, NULL, 0);
+	}
+	elapsed = now() - start;
+	printf("%-8s %12.1f %12.0f\n", launch_backendname(backend),
+	       elapsed * 1e6 / iters, iters / elapsed);
+    }
+    exit(0);
+}
@@ -0,0 +1,1114 @@
+/* stdcmd.c
+ * in-process echo, printf, test and cat for tshlab
+ */
+
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "tsh_helper.h"
+#include "arena.h"
+#include "fcopy.h"
+#include "stdcmd.h"
+
+#define OUT_INIT    1024        // initial output buffer size
+
+/*********************
+ * Output, collected in one buffer and written at once
+ *********************/
+
+struct outbuf                   // Output of a command
+{
+    char *buf;                  // In the command arena, or spare
+    size_t len;                 // Bytes collected
+    size_t cap;                 // Size of buf
+    bool failed;                // A write failed
+};
+
+static char spare[OUT_INIT];    // buf if the arena is full
+
+static const char *cmd;         // argv[0] of the command, for messages
+
+/* out_init - Start collecting output */
+static void out_init(struct outbuf *o)
+{
+    o->len = 0;
+    o->failed = false;
+    o->cap = OUT_INIT;
+    if ((o->buf = arena_alloc(cmd_arena, o->cap)) == NULL)
+    {
+        o->buf = spare;
+    }
+}
+
+/* out_flush - Write out what has been collected */
+static void out_flush(struct outbuf *o)
+{
+    size_t off = 0;
+    ssize_t n;
+
+    while (off < o->len && !o->failed)
+    {
+        if ((n = write(STDOUT_FILENO, o->buf + off, o->len - off)) < 0)
+        {
+            if (errno != EINTR)
+            {
+                o->failed = true;
+            }
+            continue;
+        }
+        off += n;
+    }
+    o->len = 0;
+}
+
+/*
+ * out_room - Make room for n more bytes, growing the buffer in place,
+ * or else writing out what it holds. Returns false if n bytes cannot fit
+ */
+static bool out_room(struct outbuf *o, size_t n)
+{
+    size_t cap = o->cap;
+
+    if (o->len + n <= o->cap)
+    {
+        return true;
+    }
+    while (cap < o->len + n)
+    {
+        cap *= 2;
+    }
+    if (o->buf != spare && arena_resize(cmd_arena, o->buf, cap))
+    {
+        o->cap = cap;
+        return true;
+    }
+    out_flush(o);
+    return n <= o->cap;
+}
+
+/* out_put - Add n bytes to the output */
+static void out_put(struct outbuf *o, const char *s, size_t n)
+{
+    size_t k;
+
+    while (n > 0)
+    {
+        out_room(o, n);
+        k = o->cap - o->len < n ? o->cap - o->len : n;
+        memcpy(o->buf + o->len, s, k);
+        o->len += k;
+        s += k;
+        n -= k;
+    }
+}
+
+/* out_putc - Add a byte to the output */
+static void out_putc(struct outbuf *o, char c)
+{
+    out_room(o, 1);
+    o->buf[o->len++] = c;
+}
+
+/*
+ * out_printf - Add formatted output. Returns false if it does not fit
+ * in the buffer even when empty
+ */
+static bool out_printf(struct outbuf *o, const char *fmt, ...)
+{
+    va_list ap;
+    int n;
+
+    va_start(ap, fmt);
+    n = vsnprintf(o->buf + o->len, o->cap - o->len, fmt, ap);
+    va_end(ap);
+    if (n < 0)
+    {
+        return false;
+    }
+    if ((size_t) n >= o->cap - o->len)
+    {
+        if (!out_room(o, n + 1))
+        {
+            return false;
+        }
+        va_start(ap, fmt);
+        vsnprintf(o->buf + o->len, o->cap - o->len, fmt, ap);
+        va_end(ap);
+    }
+    o->len += n;
+    return true;
+}
+
+/* out_finish - Write the output; returns the exit status for it */
+static int out_finish(struct outbuf *o, int status)
+{
+    out_flush(o);
+    if (o->failed)
+    {
+        fprintf(stderr, "%s: write error: %s\n", cmd, strerror(errno));
+        return 1;
+    }
+    return status;
+}
+
+/*********************
+ * Escape sequences
+ *********************/
+
+// Where an escape sequence appears
+typedef enum esc_context
+{
+    ESC_ECHO,                   // echo -e: \0NNN octal, no \"
+    ESC_FORMAT,                 // printf format: \NNN octal, \"
+    ESC_B                       // printf %b argument: \0NNN octal, \"
+} esc_context;
+
+/* hexval - Value of a hex digit */
+static int hexval(char c)
+{
+    return isdigit((unsigned char) c) ? c - '0' :
+           tolower((unsigned char) c) - 'a' + 10;
+}
+
+/*
+ * escape - Decode the escape sequence that follows a backslash at s.
+ * Sets *c to the byte it stands for, or to -1 for \c (stop the output).
+ * Returns the number of characters used, 0 if s starts no escape
+ */
+static int escape(const char *s, esc_context ctx, int *c)
+{
+    const char *simple = "\\\\a\ab\be\033f\fn\nr\rt\tv\v";
+    int n, v, skip;
+
+    for (; *simple != '\0'; simple += 2)
+    {
+        if (*s == simple[0])
+        {
+            *c = (unsigned char) simple[1];
+            return 1;
+        }
+    }
+    if (*s == 'c')
+    {
+        *c = -1;
+        return 1;
+    }
+    if (*s == '\"' && ctx != ESC_ECHO)
+    {
+        *c = '\"';
+        return 1;
+    }
+    if (*s == 'x' && isxdigit((unsigned char) s[1]))
+    {
+        v = 0;
+        for (n = 1; n <= 2 && isxdigit((unsigned char) s[n]); n++)
+        {
+            v = v * 16 + hexval(s[n]);
+        }
+        *c = v;
+        return n;
+    }
+    if (*s >= '0' && *s <= '7')
+    {
+        // echo and %b take \0NNN, printf formats \NNN
+        skip = (ctx != ESC_FORMAT && *s == '0');
+        v = 0;
+        for (n = skip; n < skip + 3 && s[n] >= '0' && s[n] <= '7'; n++)
+        {
+            v = v * 8 + s[n] - '0';
+        }
+        *c = v & 0xff;
+        return n;
+    }
+    return 0;
+}
+
+/*
+ * put_escaped - Add a string, decoding its escape sequences. Returns
+ * false if it ended with \c
+ */
+static bool put_escaped(struct outbuf *o, const char *s, esc_context ctx)
+{
+    const char *plain;
+    int c, n;
+
+    while (*s != '\0')
+    {
+        plain = s;
+        while (*s != '\0' && *s != '\\')
+        {
+            s++;
+        }
+        out_put(o, plain, s - plain);
+        if (*s == '\0')
+        {
+            break;
+        }
+        if ((n = escape(s + 1, ctx, &c)) == 0)
+        {
+            out_putc(o, '\\');  // Not an escape: print it as it is
+            s++;
+            continue;
+        }
+        if (c < 0)
+        {
+            return false;
+        }
+        out_putc(o, c);
+        s += 1 + n;
+    }
+    return true;
+}
+
+/*********************
+ * echo
+ *********************/
+
+/* echo_option - Is arg a string of echo options (-n, -e, -E)? */
+static bool echo_option(const char *arg)
+{
+    if (arg[0] != '-' || arg[1] == '\0')
+    {
+        return false;
+    }
+    return arg[1 + strspn(arg + 1, "neE")] == '\0';
+}
+
+/* stdcmd_echo - echo */
+int stdcmd_echo(char *const *argv)
+{
+    bool newline = true, escapes = false;
+    char *const *ap;
+    struct outbuf o;
+
+    cmd = argv[0];
+    for (ap = argv + 1; *ap != NULL && echo_option(*ap); ap++)
+    {
+        for (const char *p = *ap + 1; *p != '\0'; p++)
+        {
+            if (*p == 'n')
+            {
+                newline = false;
+            }
+            else
+            {
+                escapes = (*p == 'e');
+            }
+        }
+    }
+
+    out_init(&o);
+    for (char *const *first = ap; *ap != NULL; ap++)
+    {
+        if (ap != first)
+        {
+            out_putc(&o, ' ');
+        }
+        if (!escapes)
+        {
+            out_put(&o, *ap, strlen(*ap));
+        }
+        else if (!put_escaped(&o, *ap, ESC_ECHO))
+        {
+            newline = false;    // \c: nothing more, not even a newline
+            break;
+        }
+    }
+    if (newline)
+    {
+        out_putc(&o, '\n');
+    }
+    return out_finish(&o, 0);
+}
+
+/*********************
+ * printf
+ *********************/
+
+/*
+ * char_value - If arg is a character constant ('c or "c), set *v to
+ * the value of the character and return true
+ */
+static bool char_value(const char *arg, intmax_t *v)
+{
+    if ((arg[0] == '\'' || arg[0] == '\"') && arg[1] != '\0')
+    {
+        *v = (unsigned char) arg[1];
+        return true;
+    }
+    return false;
+}
+
+/* check_number - Report a numeric argument that did not convert */
+static void check_number(const char *arg, const char *end, int *status)
+{
+    if (errno == ERANGE)
+    {
+        fprintf(stderr, "%s: '%s': %s\n", cmd, arg, strerror(ERANGE));
+        *status = 1;
+    }
+    else if (end == arg)
+    {
+        fprintf(stderr, "%s: '%s': expected a numeric value\n", cmd, arg);
+        *status = 1;
+    }
+    else if (*end != '\0')
+    {
+        fprintf(stderr, "%s: '%s': value not completely converted\n",
+                cmd, arg);
+        *status = 1;
+    }
+}
+
+/* arg_int - A signed integer argument (0 if there is none) */
+static intmax_t arg_int(const char *arg, int *status)
+{
+    intmax_t v;
+    char *end;
+
+    if (arg == NULL || char_value(arg, &v))
+    {
+        return arg == NULL ? 0 : v;
+    }
+    errno = 0;
+    v = strtoimax(arg, &end, 0);
+    check_number(arg, end, status);
+    return v;
+}
+
+/* arg_uint - An unsigned integer argument (0 if there is none) */
+static uintmax_t arg_uint(const char *arg, int *status)
+{
+    uintmax_t v;
+    intmax_t c;
+    char *end;
+
+    if (arg == NULL || char_value(arg, &c))
+    {
+        return arg == NULL ? 0 : (uintmax_t) c;
+    }
+    errno = 0;
+    // Like coreutils, a negative number wraps around
+    if (arg[strspn(arg, " \t")] == '-')
+    {
+        v = (uintmax_t) strtoimax(arg, &end, 0);
+    }
+    else
+    {
+        v = strtoumax(arg, &end, 0);
+    }
+    check_number(arg, end, status);
+    return v;
+}
+
+/* arg_float - A floating point argument (0 if there is none) */
+static long double arg_float(const char *arg, int *status)
+{
+    long double v;
+    intmax_t c;
+    char *end;
+
+    if (arg == NULL || char_value(arg, &c))
+    {
+        return arg == NULL ? 0 : c;
+    }
+    errno = 0;
+    v = strtold(arg, &end);
+    check_number(arg, end, status);
+    return v;
+}
+
+/*
+ * print_format - Print the format once, taking arguments from *args as
+ * its conversions need them. Returns false if the output must stop (\c
+ * or an invalid conversion)
+ */
+static bool print_format(struct outbuf *o, const char *format,
+                         char *const **args, int *status)
+{
+    const char *f = format, *start, *arg;
+    char spec[32];
+    int width, prec, n;
+    bool ok = true;
+
+    while (*f != '\0')
+    {
+        if (*f == '\\')
+        {
+            int c;
+            if ((n = escape(f + 1, ESC_FORMAT, &c)) == 0)
+            {
+                out_putc(o, '\\');
+                f++;
+                continue;
+            }
+            if (c < 0)
+            {
+                return false;
+            }
+            out_putc(o, c);
+            f += 1 + n;
+            continue;
+        }
+        if (*f != '%')
+        {
+            start = f;
+            while (*f != '\0' && *f != '%' && *f != '\\')
+            {
+                f++;
+            }
+            out_put(o, start, f - start);
+            continue;
+        }
+
+        start = f++;
+        if (*f == '%')
+        {
+            out_putc(o, '%');
+            f++;
+            continue;
+        }
+        if (*f == 'b')
+        {
+            arg = **args != NULL ? *(*args)++ : "";
+            f++;
+            if (!put_escaped(o, arg, ESC_B))
+            {
+                return false;
+            }
+            continue;
+        }
+
+        // %[flags][width][.precision]conversion, rebuilt as
+        // %[flags]*.*conversion
+        n = 0;
+        spec[n++] = '%';
+        while (*f != '\0' && strchr("-+ #0'", *f) != NULL && n < 8)
+        {
+            spec[n++] = *f++;
+        }
+        width = 0;
+        if (*f == '*')
+        {
+            width = (int) arg_int(**args != NULL ? *(*args)++ : NULL, status);
+            f++;
+        }
+        else
+        {
+            for (; isdigit((unsigned char) *f); f++)
+            {
+                width = width * 10 + *f - '0';
+            }
+        }
+        prec = -1;
+        if (*f == '.')
+        {
+            f++;
+            prec = 0;
+            if (*f == '*')
+            {
+                prec = (int) arg_int(**args != NULL ? *(*args)++ : NULL,
+                                     status);
+                f++;
+            }
+            else
+            {
+                for (; isdigit((unsigned char) *f); f++)
+                {
+                    prec = prec * 10 + *f - '0';
+                }
+            }
+        }
+        if (*f == '\0' || strchr("diouxXcseEfFgGaA", *f) == NULL)
+        {
+            fprintf(stderr, "%s: %.*s: invalid conversion "
+                    "specification\n", cmd, (int) (f - start + (*f != '\0')),
+                    start);
+            *status = 1;
+            return false;
+        }
+        arg = **args != NULL ? *(*args)++ : NULL;
+        strcpy(spec + n, *f == 'c' ? "*" : "*.*");
+        n = strlen(spec);
+
+        switch (*f)
+        {
+        case 'd':
+        case 'i':
+            spec[n++] = 'j';
+            spec[n++] = *f;
+            spec[n] = '\0';
+            ok = out_printf(o, spec, width, prec, arg_int(arg, status));
+            break;
+        case 'o':
+        case 'u':
+        case 'x':
+        case 'X':
+            spec[n++] = 'j';
+            spec[n++] = *f;
+            spec[n] = '\0';
+            ok = out_printf(o, spec, width, prec, arg_uint(arg, status));
+            break;
+        case 'c':
+            spec[n++] = 'c';
+            spec[n] = '\0';
+            ok = out_printf(o, spec, width, arg != NULL ? arg[0] : '\0');
+            break;
+        case 's':
+            spec[n++] = 's';
+            spec[n] = '\0';
+            ok = out_printf(o, spec, width, prec, arg != NULL ? arg : "");
+            break;
+        default:
+            spec[n++] = 'L';
+            spec[n++] = *f;
+            spec[n] = '\0';
+            ok = out_printf(o, spec, width, prec, arg_float(arg, status));
+            break;
+        }
+        if (!ok)
+        {
+            fprintf(stderr, "%s: output too long\n", cmd);
+            *status = 1;
+            return false;
+        }
+        f++;
+    }
+    return true;
+}
+
+/* stdcmd_printf - printf */
+int stdcmd_printf(char *const *argv)
+{
+    char *const *args, *const *before;
+    struct outbuf o;
+    int status = 0;
+
+    cmd = argv[0];
+    if (argv[1] == NULL)
+    {
+        fprintf(stderr, "%s: missing operand\n", cmd);
+        fprintf(stderr, "Try '%s --help' for more information.\n", cmd);
+        return 1;
+    }
+    out_init(&o);
+    args = argv + 2;
+    do
+    {
+        before = args;
+        if (!print_format(&o, argv[1], &args, &status))
+        {
+            break;
+        }
+    } while (*args != NULL && args != before);
+    return out_finish(&o, status);
+}
+
+/*********************
+ * test
+ *********************/
+
+struct test_state               // A test expression being evaluated
+{
+    char *const *argv;          // Its operands
+    int pos;                    // Next operand
+    int end;                    // Index after the last operand
+    const char *name;           // argv[0], for messages
+    bool error;                 // A syntax error was reported
+};
+
+static bool test_expr(struct test_state *t);
+
+/* test_syntax - Report a syntax error */
+static bool test_syntax(struct test_state *t, const char *fmt, const char *arg)
+{
+    if (!t->error)
+    {
+        fprintf(stderr, "%s: ", t->name);
+        fprintf(stderr, fmt, arg);
+        fputc('\n', stderr);
+    }
+    t->error = true;
+    return false;
+}
+
+/* test_arg - The operand at pos + i, or NULL beyond the end */
+static const char *test_arg(const struct test_state *t, int i)
+{
+    return t->pos + i < t->end ? t->argv[t->pos + i] : NULL;
+}
+
+/* is_binop - Is s a binary operator? */
+static bool is_binop(const char *s)
+{
+    static const char *ops[] = {
+        "=", "==", "!=", "-eq", "-ne", "-lt", "-le", "-gt",
+        "-ge", "-nt", "-ot", "-ef", NULL
+    };
+
+    for (int i = 0; s != NULL && ops[i] != NULL; i++)
+    {
+        if (strcmp(s, ops[i]) == 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* is_unop - Is s a unary operator? */
+static bool is_unop(const char *s)
+{
+    return s != NULL && s[0] == '-' && s[1] != '\0' && s[2] == '\0' &&
+           strchr("bcdefgGhkLnOprsStuwxz", s[1]) != NULL;
+}
+
+/* test_int - Convert an integer operand */
+static intmax_t test_int(struct test_state *t, const char *s)
+{
+    const char *p = s + strspn(s, " \t");
+    intmax_t v;
+    char *end;
+
+    errno = 0;
+    v = strtoimax(p, &end, 10);
+    end += strspn(end, " \t");
+    if (end == p || *end != '\0' || errno == ERANGE)
+    {
+        test_syntax(t, "invalid integer '%s'", s);
+        return 0;
+    }
+    return v;
+}
+
+/* mtime_cmp - Compare the modification times of two files */
+static int mtime_cmp(const struct stat *a, const struct stat *b)
+{
+    if (a->st_mtim.tv_sec != b->st_mtim.tv_sec)
+    {
+        return a->st_mtim.tv_sec < b->st_mtim.tv_sec ? -1 : 1;
+    }
+    if (a->st_mtim.tv_nsec != b->st_mtim.tv_nsec)
+    {
+        return a->st_mtim.tv_nsec < b->st_mtim.tv_nsec ? -1 : 1;
+    }
+    return 0;
+}
+
+/* test_binary - Evaluate the operator at pos + 1 on its two operands */
+static bool test_binary(struct test_state *t)
+{
+    const char *l = test_arg(t, 0), *op = test_arg(t, 1), *r = test_arg(t, 2);
+    struct stat ls, rs;
+    bool lok, rok;
+    intmax_t a, b;
+
+    t->pos += 3;
+    if (strcmp(op, "=") == 0 || strcmp(op, "==") == 0)
+    {
+        return strcmp(l, r) == 0;
+    }
+    if (strcmp(op, "!=") == 0)
+    {
+        return strcmp(l, r) != 0;
+    }
+    if (op[1] == 'n' || op[1] == 'o' || strcmp(op, "-ef") == 0)
+    {
+        if (strcmp(op, "-ne") != 0)
+        {
+            lok = stat(l, &ls) == 0;
+            rok = stat(r, &rs) == 0;
+            if (strcmp(op, "-nt") == 0)
+            {
+                return lok && (!rok || mtime_cmp(&ls, &rs) > 0);
+            }
+            if (strcmp(op, "-ot") == 0)
+            {
+                return rok && (!lok || mtime_cmp(&ls, &rs) < 0);
+            }
+            return lok && rok && ls.st_dev == rs.st_dev &&
+                   ls.st_ino == rs.st_ino;
+        }
+    }
+    a = test_int(t, l);
+    b = test_int(t, r);
+    switch (op[1] * 256 + op[2])
+    {
+    case 'e' * 256 + 'q':
+        return a == b;
+    case 'n' * 256 + 'e':
+        return a != b;
+    case 'l' * 256 + 't':
+        return a < b;
+    case 'l' * 256 + 'e':
+        return a <= b;
+    case 'g' * 256 + 't':
+        return a > b;
+    default:
+        return a >= b;
+    }
+}
+
+/* test_unary - Evaluate the operator at pos on its operand */
+static bool test_unary(struct test_state *t)
+{
+    char op = test_arg(t, 0)[1];
+    const char *s = test_arg(t, 1);
+    struct stat st;
+
+    t->pos += 2;
+    switch (op)
+    {
+    case 'n':
+        return s[0] != '\0';
+    case 'z':
+        return s[0] == '\0';
+    case 'r':
+        return access(s, R_OK) == 0;
+    case 'w':
+        return access(s, W_OK) == 0;
+    case 'x':
+        return access(s, X_OK) == 0;
+    case 't':
+        return isatty((int) test_int(t, s));
+    case 'h':
+    case 'L':
+        return lstat(s, &st) == 0 && S_ISLNK(st.st_mode);
+    }
+    if (stat(s, &st) < 0)
+    {
+        return false;
+    }
+    switch (op)
+    {
+    case 'b':
+        return S_ISBLK(st.st_mode);
+    case 'c':
+        return S_ISCHR(st.st_mode);
+    case 'd':
+        return S_ISDIR(st.st_mode);
+    case 'f':
+        return S_ISREG(st.st_mode);
+    case 'p':
+        return S_ISFIFO(st.st_mode);
+    case 'S':
+        return S_ISSOCK(st.st_mode);
+    case 's':
+        return st.st_size > 0;
+    case 'g':
+        return (st.st_mode & S_ISGID) != 0;
+    case 'u':
+        return (st.st_mode & S_ISUID) != 0;
+    case 'k':
+        return (st.st_mode & S_ISVTX) != 0;
+    case 'O':
+        return st.st_uid == geteuid();
+    case 'G':
+        return st.st_gid == getegid();
+    default:                    // 'e'
+        return true;
+    }
+}
+
+/* test_term - A primary, possibly negated or in parentheses */
+static bool test_term(struct test_state *t)
+{
+    const char *s = test_arg(t, 0);
+    bool value;
+
+    if (s == NULL)
+    {
+        return test_syntax(t, "missing argument after '%s'",
+                           t->argv[t->pos - 1]);
+    }
+    if (strcmp(s, "!") == 0)
+    {
+        t->pos++;
+        return !test_term(t);
+    }
+    if (strcmp(s, "(") == 0)
+    {
+        t->pos++;
+        value = test_expr(t);
+        if (test_arg(t, 0) == NULL || strcmp(test_arg(t, 0), ")") != 0)
+        {
+            return test_syntax(t, "missing argument after '%s'",
+                               t->argv[t->pos - 1]);
+        }
+        t->pos++;
+        return value;
+    }
+    if (is_binop(test_arg(t, 1)) && test_arg(t, 2) != NULL)
+    {
+        return test_binary(t);
+    }
+    if (is_unop(s) && test_arg(t, 1) != NULL)
+    {
+        return test_unary(t);
+    }
+    t->pos++;
+    return s[0] != '\0';
+}
+
+/* test_and - Terms joined by -a */
+static bool test_and(struct test_state *t)
+{
+    bool value = test_term(t);
+
+    while (test_arg(t, 0) != NULL && strcmp(test_arg(t, 0), "-a") == 0)
+    {
+        t->pos++;
+        value = test_term(t) && value;
+    }
+    return value;
+}
+
+/* test_expr - Terms joined by -a and -o */
+static bool test_expr(struct test_state *t)
+{
+    bool value = test_and(t);
+
+    while (test_arg(t, 0) != NULL && strcmp(test_arg(t, 0), "-o") == 0)
+    {
+        t->pos++;
+        value = test_and(t) || value;
+    }
+    return value;
+}
+
+/*
+ * test_posix - Evaluate n operands, by their number as POSIX specifies
+ * for up to four, and as an expression beyond that
+ */
+static bool test_posix(struct test_state *t, int n)
+{
+    const char *a0 = test_arg(t, 0);
+
+    switch (n)
+    {
+    case 0:
+        return false;
+    case 1:
+        t->pos++;
+        return a0[0] != '\0';
+    case 2:
+        if (strcmp(a0, "!") == 0)
+        {
+            t->pos++;
+            return !test_posix(t, 1);
+        }
+        if (is_unop(a0))
+        {
+            return test_unary(t);
+        }
+        if (a0[0] == '-' && a0[1] != '\0' && a0[2] == '\0')
+        {
+            return test_syntax(t, "'%s': unary operator expected", a0);
+        }
+        return test_syntax(t, "missing argument after '%s'", test_arg(t, 1));
+    case 3:
+        if (is_binop(test_arg(t, 1)))
+        {
+            return test_binary(t);
+        }
+        if (strcmp(a0, "!") == 0)
+        {
+            t->pos++;
+            return !test_posix(t, 2);
+        }
+        if (strcmp(a0, "(") == 0 && strcmp(test_arg(t, 2), ")") == 0)
+        {
+            t->pos++;
+            bool value = test_posix(t, 1);
+            t->pos++;
+            return value;
+        }
+        if (strcmp(test_arg(t, 1), "-a") == 0 ||
+            strcmp(test_arg(t, 1), "-o") == 0)
+        {
+            return test_expr(t);
+        }
+        return test_syntax(t, "'%s': binary operator expected",
+                           test_arg(t, 1));
+    case 4:
+        if (strcmp(a0, "!") == 0)
+        {
+            t->pos++;
+            return !test_posix(t, 3);
+        }
+        if (strcmp(a0, "(") == 0 && strcmp(test_arg(t, 3), ")") == 0)
+        {
+            t->pos++;
+            bool value = test_posix(t, 2);
+            t->pos++;
+            return value;
+        }
+        return test_expr(t);
+    default:
+        return test_expr(t);
+    }
+}
+
+/* stdcmd_test - test and [ */
+int stdcmd_test(char *const *argv)
+{
+    struct test_state t;
+    const char *base = strrchr(argv[0], '/');
+    bool value;
+    int argc;
+
+    for (argc = 0; argv[argc] != NULL; argc++)
+        ;
+    t.argv = argv;
+    t.pos = 1;
+    t.end = argc;
+    t.name = argv[0];
+    t.error = false;
+
+    if (strcmp(base != NULL ? base + 1 : argv[0], "[") == 0)
+    {
+        if (argc < 2 || strcmp(argv[argc - 1], "]") != 0)
+        {
+            fprintf(stderr, "%s: missing ']'\n", t.name);
+            return 2;
+        }
+        t.end--;
+    }
+    value = test_posix(&t, t.end - t.pos);
+    if (!t.error && t.pos < t.end)
+    {
+        test_syntax(&t, "extra argument '%s'", t.argv[t.pos]);
+    }
+    return t.error ? 2 : !value;
+}
+
+/*********************
+ * cat
+ *********************/
+
+/* cat_input - Is the file at path one the cat builtin may read? */
+static bool cat_input(const char *path)
+{
+    struct stat st;
+
+    // A file that cannot be opened is the builtin's to report
+    return stat(path, &st) < 0 || S_ISREG(st.st_mode);
+}
+
+/*
+ * cat_output - Is the output, outfile or else stdout, one the cat
+ * builtin may write to? Only a regular file or /dev/null never blocks
+ */
+static bool cat_output(const char *outfile)
+{
+    struct stat st, null;
+
+    if (outfile != NULL ? stat(outfile, &st) < 0
+                        : fstat(STDOUT_FILENO, &st) < 0)
+    {
+        // A file that does not exist yet is created as a regular file
+        return outfile != NULL && errno == ENOENT;
+    }
+    if (S_ISREG(st.st_mode))
+    {
+        return true;
+    }
+    return S_ISCHR(st.st_mode) && stat("/dev/null", &null) == 0 &&
+           st.st_rdev == null.st_rdev;
+}
+
+/* cat_file - Copy a cat operand to stdout; false on an error */
+static bool cat_file(const char *name, bool *out_failed)
+{
+    int fd = STDIN_FILENO;
+    bool ok = true;
+
+    if (strcmp(name, "-") != 0 && (fd = open(name, O_RDONLY | O_CLOEXEC)) < 0)
+    {
+        fprintf(stderr, "%s: %s: %s\n", cmd, name, strerror(errno));
+        return false;
+    }
+    if (fcopy(fd, STDOUT_FILENO, out_failed, NULL) < 0)
+    {
+        if (*out_failed)
+        {
+            fprintf(stderr, "%s: write error: %s\n", cmd, strerror(errno));
+        }
+        else
+        {
+            fprintf(stderr, "%s: %s: %s\n", cmd, name, strerror(errno));
+        }
+        ok = false;
+    }
+    if (fd != STDIN_FILENO)
+    {
+        close(fd);
+    }
+    return ok;
+}
+
+/* stdcmd_cat - cat */
+int stdcmd_cat(char *const *argv)
+{
+    char *const *args = argv[1] != NULL ? argv + 1 : (char *[]) { "-", NULL };
+    bool out_failed = false;
+    int status = 0;
+
+    cmd = argv[0];
+    for (; *args != NULL && !out_failed; args++)
+    {
+        if (!cat_file(*args, &out_failed))
+        {
+            status = 1;
+        }
+    }
+    return status;
+}
+
+/* stdcmd_wantsreal - Should the real utility run this command? */
+bool stdcmd_wantsreal(char *const *argv, const char *infile,
+                      const char *outfile)
+{
+    const char *base = strrchr(argv[0], '/');
+    struct stat st;
+    bool stdin_read;
+    int i;
+
+    if (strcmp(base != NULL ? base + 1 : argv[0], "cat") == 0)
+    {
+        // Options, and input or output that may never end, are left
+        // to cat
+        if (!cat_output(outfile))
+        {
+            return true;
+        }
+        stdin_read = argv[1] == NULL;
+        for (i = 1; argv[i] != NULL; i++)
+        {
+            if (strcmp(argv[i], "-") == 0)
+            {
+                stdin_read = true;
+            }
+            else if (argv[i][0] == '-' || !cat_input(argv[i]))
+            {
+                return true;
+            }
+        }
+        if (stdin_read)
+        {
+            return infile != NULL ? !cat_input(infile) :
+                   fstat(STDIN_FILENO, &st) < 0 || !S_ISREG(st.st_mode);
+        }
+        return false;
+    }
+    return strchr(argv[0], '/') != NULL && argv[1] != NULL &&
+           argv[2] == NULL && (strcmp(argv[1], "--help") == 0 ||
+                               strcmp(argv[1], "--version") == 0);
+}
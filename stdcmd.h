@@ -0,0 +1,56 @@
+/*
+ * stdcmd.h: in-process echo, printf, test and cat for tshlab
+ *
+ * stdcmd.h defines the bodies of the builtins that stand in for the
+ * echo, printf, test and cat utilities (and for /bin/echo and friends,
+ * which the trace files run before nearly every command), so that they
+ * cost no fork and no exec. Each behaves like its GNU coreutils
+ * counterpart in the C locale, escape sequences included. echo, printf
+ * and test write their output to stdout with a single write(), built up
+ * in the command arena; cat has the kernel copy the files (fcopy.h).
+ *
+ * Each function takes the argv of the command and returns its exit
+ * status. Errors are reported on stderr, as the utilities do.
+ */
+
+#ifndef __STDCMD_H__
+#define __STDCMD_H__
+
+#include <stdbool.h>
+
+/*
+ * stdcmd_echo writes its arguments separated by spaces, with the
+ * options -n, -e and -E of GNU echo.
+ */
+int stdcmd_echo(char *const *argv);
+
+/*
+ * stdcmd_printf writes its arguments under the control of a format,
+ * reusing the format while arguments remain.
+ */
+int stdcmd_printf(char *const *argv);
+
+/*
+ * stdcmd_test evaluates a test (or, if argv[0] is "[", a [ ... ])
+ * expression. Returns 0 if it is true, 1 if false and 2 on error.
+ */
+int stdcmd_test(char *const *argv);
+
+/*
+ * stdcmd_cat copies its file operands ("-", or none, for stdin) to
+ * stdout, without options.
+ */
+int stdcmd_cat(char *const *argv);
+
+/*
+ * stdcmd_wantsreal returns true if the command, whose input and output
+ * are redirected from infile and to outfile (or NULL), should be run by
+ * the real utility instead: a GNU utility named by path asked for its
+ * --help or --version, or cat was given options, input other than
+ * regular files, or output other than a regular file or /dev/null,
+ * which the shell could wait on forever.
+ */
+bool stdcmd_wantsreal(char *const *argv, const char *infile,
+                      const char *outfile);
+
+#endif
@@ -0,0 +1,346 @@
+/* tokenize.c
+ * command line tokenizer for tshlab
+ */
+
+#include <string.h>
+#include "tokenize.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define HAVE_X86_SIMD
+#endif
+
+struct scanner                  // One implementation of the searches
+{
+    const char *name;
+    // Index of the first byte at or after i that is not white space
+    size_t (*skip_ws)(const char *s, size_t i, size_t n);
+    // Index of the first white space byte at or after i
+    size_t (*find_ws)(const char *s, size_t i, size_t n);
+    // Index of the first c at or after i
+    size_t (*find_byte)(const char *s, size_t i, size_t n, char c);
+};
+
+/*********************
+ * Scalar searches
+ *********************/
+
+/* is_ws - Is c a delimiter? */
+static inline bool is_ws(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+static size_t skip_ws_scalar(const char *s, size_t i, size_t n)
+{
+    while (i < n && is_ws(s[i]))
+    {
+        i++;
+    }
+    return i;
+}
+
+static size_t find_ws_scalar(const char *s, size_t i, size_t n)
+{
+    while (i < n && !is_ws(s[i]))
+    {
+        i++;
+    }
+    return i;
+}
+
+static size_t find_byte_scalar(const char *s, size_t i, size_t n, char c)
+{
+    while (i < n && s[i] != c)
+    {
+        i++;
+    }
+    return i;
+}
+
+static const struct scanner scalar_scanner =
+{
+    "scalar", skip_ws_scalar, find_ws_scalar, find_byte_scalar
+};
+
+#ifdef HAVE_X86_SIMD
+
+/*********************
+ * SSE2 searches (part of x86-64, so always available there)
+ *********************/
+
+/* ws_mask16 - Bit i is set if byte i of the 16 at p is white space */
+static inline unsigned ws_mask16(const char *p)
+{
+    __m128i v = _mm_loadu_si128((const __m128i *) p);
+    __m128i m = _mm_or_si128(
+        _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')),
+                     _mm_cmpeq_epi8(v, _mm_set1_epi8('\t'))),
+        _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\r')),
+                     _mm_cmpeq_epi8(v, _mm_set1_epi8('\n'))));
+
+    return (unsigned) _mm_movemask_epi8(m);
+}
+
+static size_t skip_ws_sse2(const char *s, size_t i, size_t n)
+{
+    unsigned m;
+
+    // Runs of white space are usually a single byte
+    if (i < n && !is_ws(s[i]))
+    {
+        return i;
+    }
+    for (; i + 16 <= n; i += 16)
+    {
+        if ((m = ~ws_mask16(s + i) & 0xffff) != 0)
+        {
+            return i + __builtin_ctz(m);
+        }
+    }
+    return skip_ws_scalar(s, i, n);
+}
+
+static size_t find_ws_sse2(const char *s, size_t i, size_t n)
+{
+    unsigned m;
+
+    for (; i + 16 <= n; i += 16)
+    {
+        if ((m = ws_mask16(s + i)) != 0)
+        {
+            return i + __builtin_ctz(m);
+        }
+    }
+    return find_ws_scalar(s, i, n);
+}
+
+static size_t find_byte_sse2(const char *s, size_t i, size_t n, char c)
+{
+    __m128i want = _mm_set1_epi8(c);
+    unsigned m;
+
+    for (; i + 16 <= n; i += 16)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *) (s + i));
+        if ((m = (unsigned) _mm_movemask_epi8(_mm_cmpeq_epi8(v, want))) != 0)
+        {
+            return i + __builtin_ctz(m);
+        }
+    }
+    return find_byte_scalar(s, i, n, c);
+}
+
+static const struct scanner sse2_scanner =
+{
+    "sse2", skip_ws_sse2, find_ws_sse2, find_byte_sse2
+};
+
+/*********************
+ * AVX2 searches (only used if the CPU has AVX2)
+ *
+ * These must not call the SSE2 functions above: those are compiled
+ * without VEX encoding, and mixing the two costs a state transition
+ * on every call. ws_mask16 is inlined, and so VEX-encoded, here.
+ *********************/
+
+#define AVX2 __attribute__((target("avx2")))
+
+/* ws_mask32 - Bit i is set if byte i of the 32 at p is white space */
+AVX2 static inline unsigned ws_mask32(const char *p)
+{
+    __m256i v = _mm256_loadu_si256((const __m256i *) p);
+    __m256i m = _mm256_or_si256(
+        _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')),
+                        _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\t'))),
+        _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\r')),
+                        _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n'))));
+
+    return (unsigned) _mm256_movemask_epi8(m);
+}
+
+AVX2 static size_t skip_ws_avx2(const char *s, size_t i, size_t n)
+{
+    unsigned m;
+
+    if (i < n && !is_ws(s[i]))
+    {
+        return i;
+    }
+    for (; i + 32 <= n; i += 32)
+    {
+        if ((m = ~ws_mask32(s + i)) != 0)
+        {
+            return i + __builtin_ctz(m);
+        }
+    }
+    if (i + 16 <= n)
+    {
+        if ((m = ~ws_mask16(s + i) & 0xffff) != 0)
+        {
+            return i + __builtin_ctz(m);
+        }
+        i += 16;
+    }
+    return skip_ws_scalar(s, i, n);
+}
+
+AVX2 static size_t find_ws_avx2(const char *s, size_t i, size_t n)
+{
+    unsigned m;
+
+    for (; i + 32 <= n; i += 32)
+    {
+        if ((m = ws_mask32(s + i)) != 0)
+        {
+            return i + __builtin_ctz(m);
+        }
+    }
+    if (i + 16 <= n)
+    {
+        if ((m = ws_mask16(s + i)) != 0)
+        {
+            return i + __builtin_ctz(m);
+        }
+        i += 16;
+    }
+    return find_ws_scalar(s, i, n);
+}
+
+AVX2 static size_t find_byte_avx2(const char *s, size_t i, size_t n, char c)
+{
+    __m256i want = _mm256_set1_epi8(c);
+    unsigned m;
+
+    for (; i + 32 <= n; i += 32)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i *) (s + i));
+        m = (unsigned) _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, want));
+        if (m != 0)
+        {
+            return i + __builtin_ctz(m);
+        }
+    }
+    return find_byte_scalar(s, i, n, c);
+}
+
+static const struct scanner avx2_scanner =
+{
+    "avx2", skip_ws_avx2, find_ws_avx2, find_byte_avx2
+};
+
+#endif /* HAVE_X86_SIMD */
+
+static const struct scanner *scanner;   // Searches in use, NULL until set
+
+/* best_scanner - The fastest searches the CPU supports */
+static const struct scanner *best_scanner(void)
+{
+#ifdef HAVE_X86_SIMD
+    if (__builtin_cpu_supports("avx2"))
+    {
+        return &avx2_scanner;
+    }
+    return &sse2_scanner;
+#else
+    return &scalar_scanner;
+#endif
+}
+
+/* tokenize_setimpl - Select the searches by name */
+bool tokenize_setimpl(const char *name)
+{
+    if (strcmp(name, "auto") == 0)
+    {
+        scanner = best_scanner();
+        return true;
+    }
+    if (strcmp(name, "scalar") == 0)
+    {
+        scanner = &scalar_scanner;
+        return true;
+    }
+#ifdef HAVE_X86_SIMD
+    if (strcmp(name, "sse2") == 0)
+    {
+        scanner = &sse2_scanner;
+        return true;
+    }
+    if (strcmp(name, "avx2") == 0 && __builtin_cpu_supports("avx2"))
+    {
+        scanner = &avx2_scanner;
+        return true;
+    }
+#endif
+    return false;
+}
+
+/* tokenize_implname - Name of the searches in use */
+const char *tokenize_implname(void)
+{
+    if (scanner == NULL)
+    {
+        scanner = best_scanner();
+    }
+    return scanner->name;
+}
+
+/* tokenize - Split a line into token spans */
+int tokenize(const char *line, size_t len, size_t *pos,
+             struct tok_span *spans, int max, size_t *errpos)
+{
+    const struct scanner *sc;
+    size_t i = *pos, end;
+    int n = 0;
+    char c;
+
+    if (scanner == NULL)
+    {
+        scanner = best_scanner();
+    }
+    sc = scanner;
+    *errpos = TOK_NOERROR;
+
+    while (n < max)
+    {
+        if ((i = sc->skip_ws(line, i, len)) >= len)
+        {
+            break;
+        }
+        c = line[i];
+
+        // Operators are only recognised at the start of a token
+        if (c == '<' || c == '>' || c == '|')
+        {
+            spans[n].off = i;
+            spans[n].len = 1;
+            spans[n].kind = c == '<' ? TOK_INFILE :
+                            c == '>' ? TOK_OUTFILE : TOK_PIPE;
+            n++;
+            i++;
+            continue;
+        }
+
+        if (c == '\'' || c == '\"')
+        {
+            end = sc->find_byte(line, i + 1, len, c);
+            if (end >= len)
+            {
+                *errpos = i;
+                break;
+            }
+            spans[n].off = i + 1;
+        }
+        else
+        {
+            end = sc->find_ws(line, i, len);
+            spans[n].off = i;
+        }
+        spans[n].len = end - spans[n].off;
+        spans[n].kind = TOK_WORD;
+        n++;
+        i = end + 1;            // Past the delimiter or closing quote
+    }
+    *pos = i;
+    return n;
+}
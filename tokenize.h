@@ -0,0 +1,68 @@
+/*
+ * tokenize.h: command line tokenizer for tshlab
+ *
+ * tokenize.h defines the scanner behind parseline. It does not copy or
+ * modify the line: it describes each token as a span (offset and
+ * length) of the caller's buffer, and parseline turns the spans into
+ * the NUL-terminated argv of struct cmdline_tokens.
+ *
+ * Tokens are separated by white space (space, tab, CR, LF). A token that
+ * starts with a quote (' or ") runs to the matching quote, white space
+ * included, and the span excludes the quotes. '<', '>' and '|' are
+ * operators only at the start of a token; elsewhere they are ordinary
+ * characters, as is '&' (parseline looks at the last word for it).
+ *
+ * The white space and quote searches run 16 bytes at a time with SSE2,
+ * or 32 with AVX2 when the CPU has it, with a scalar fallback for other
+ * machines and for the tail of the line.
+ */
+
+#ifndef __TOKENIZE_H__
+#define __TOKENIZE_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Kinds of token
+typedef enum tok_kind
+{
+    TOK_WORD,                   // An argument or file name
+    TOK_INFILE,                 // <
+    TOK_OUTFILE,                // >
+    TOK_PIPE                    // |
+} tok_kind;
+
+struct tok_span                 // A token, as a span of the line
+{
+    unsigned off;               // Offset of its first byte
+    unsigned len;               // Length in bytes
+    tok_kind kind;              // What it is
+};
+
+#define TOK_NOERROR ((size_t) -1)   // errpos when all quotes are matched
+
+/*
+ * tokenize splits the first len bytes of line into spans, starting at
+ * offset *pos, and returns how many it produced. It stops after max
+ * spans, leaving *pos where the next call should resume, so a long line
+ * can be split in batches. If it stops at a quote that is never closed,
+ * *errpos is set to the offset of that quote, and to TOK_NOERROR
+ * otherwise.
+ */
+int tokenize(const char *line, size_t len, size_t *pos,
+             struct tok_span *spans, int max, size_t *errpos);
+
+/*
+ * tokenize_setimpl selects the scanning code by name: "scalar", "sse2",
+ * "avx2", or "auto" (the best one the CPU supports, the default).
+ * Returns false if the name is unknown or the CPU lacks the instructions.
+ * For benchmarks.
+ */
+bool tokenize_setimpl(const char *name);
+
+/*
+ * tokenize_implname returns the name of the scanning code in use.
+ */
+const char *tokenize_implname(void);
+
+#endif
@@ -6,6 +6,31 @@
  */
 
 #include "tsh_helper.h"
+#include "launch.h"
+#include "pathhash.h"
+#include "jobring.h"
+#include "eventloop.h"
+#include "sigmask.h"
+#include "arena.h"
+#include "input.h"
+#include "parsecache.h"
+#include "stdcmd.h"
+#include "envtab.h"
+#include <sys/pidfd.h>
+
+/*
+ * pidfd_send_signal flag that signals the whole process group of the
+ * pidfd's process (Linux 6.9). Older kernels reject it with EINVAL.
+ */
+#ifndef PIDFD_SIGNAL_PROCESS_GROUP
+#define PIDFD_SIGNAL_PROCESS_GROUP (1U << 2)
+#endif
+
+// Room for one "Job [n] (pid) ..." notice
+#define NOTICE_MAX 64
+
+// Background jobs whose exit status is kept for the wait builtin
+#define DONE_MAX 64
 
 /*
  * If DEBUG is defined, enable contracts and printing on dbg_printf.
@@ -27,7 +52,51 @@
 /* Function prototypes */
 void eval(const char *cmdline);
 
-void sigchld_handler(int sig);
+// If true, signals arrive through the event loop instead of handlers
+bool event_mode = false;
+
+// If true, so do the command lines (tsh -e, unless given -c)
+bool event_input = false;
+
+// If true, the last command of the input may replace the shell (tsh -c
+// and scripts not read through the event loop)
+bool tail_exec = false;
+
+// The signals that guard the job list: SIGCHLD, SIGINT and SIGTSTP
+sigset_t job_sigs;
+
+// Exit status of the last foreground command (128+n if killed by signal n)
+int last_status = 0;
+
+// What the wait builtin is waiting for. Jobs it waits for by name are
+// marked (job_t.waited); updateJobStatus counts them off as they end or
+// stop, so each costs O(1) however many jobs there are
+struct waiter
+{
+    int pending;                // Marked jobs still running
+    int ndone;                  // Jobs that ended or stopped meanwhile
+    bool any;                   // Every background job counts (wait -n)
+    int keyjid;                 // Job whose status wait returns, 0 for
+                                // the first one done
+    int status;                 // Its exit status
+};
+struct waiter waiter;
+
+// Background jobs that ended before wait named them, oldest first. Like
+// other shells, tsh keeps their statuses until they are waited for
+struct donejob
+{
+    pid_t pid;                  // pid of the job's first process
+    int jid;                    // Its job ID
+    int status;                 // Its exit status
+};
+struct donejob donejobs[DONE_MAX];
+int ndonejobs = 0;
+
+// Set by ctrl-c when there is no foreground job, to interrupt wait
+volatile sig_atomic_t interrupted = 0;
+
+void sigchld_handler(int sig, siginfo_t *info, void *context);
 void sigtstp_handler(int sig);
 void sigint_handler(int sig);
 void sigquit_handler(int sig);
@@ -44,15 +113,19 @@ void sigquit_handler(int sig);
 int main(int argc, char **argv) 
 {
     char c;
-    char cmdline[MAXLINE_TSH];  // Cmdline for fgets
+    char *cmdline;              // The command line read
+    char *command = NULL;       // The commands given with -c
     bool emit_prompt = true;    // Emit prompt (default)
+    long argmax;                // Longest command the kernel accepts
+    int input_fd = STDIN_FILENO;    // Input of the event loop
+    struct sigaction action;    // SIGCHLD wants the siginfo of the child
 
     // Redirect stderr to stdout (so that driver will get all output
     // on the pipe connected to stdout)
     Dup2(STDOUT_FILENO, STDERR_FILENO);
 
     // Parse the command line
-    while ((c = getopt(argc, argv, "hvp")) != EOF)
+    while ((c = getopt(argc, argv, "hvpel:c:")) != EOF)
     {
         switch (c)
         {
@@ -65,15 +138,104 @@ int main(int argc, char **argv)
         case 'p':                   // Disables prompt printing
             emit_prompt = false;  
             break;
+        case 'e':                   // Uses the signalfd/epoll event loop
+            event_mode = true;
+            break;
+        case 'c':                   // Runs the commands in a string
+            command = optarg;
+            break;
+        case 'l':                   // Selects the job launch backend
+            if (!launch_setbackend(optarg))
+            {
+                usage();
+            }
+            break;
         default:
             usage();
         }
     }
 
-    // Install the signal handlers
-    Signal(SIGINT,  sigint_handler);   // Handles ctrl-c
-    Signal(SIGTSTP, sigtstp_handler);  // Handles ctrl-z
-    Signal(SIGCHLD, sigchld_handler);  // Handles terminated or stopped child
+    // Read the commands from the -c string or from a script file if one
+    // is named. There is no prompt for either, and the last command can
+    // replace the shell
+    if (command != NULL)
+    {
+        emit_prompt = false;
+        tail_exec = true;
+        input_string(command);
+    }
+    else if (optind < argc)
+    {
+        emit_prompt = false;
+        tail_exec = !event_mode;
+        if (event_mode)
+        {
+            // The event loop reads (and polls) a descriptor
+            if ((input_fd = open(argv[optind], O_RDONLY | O_CLOEXEC)) < 0)
+            {
+                unix_error(argv[optind]);
+            }
+        }
+        else if (!input_open(argv[optind]))
+        {
+            unix_error(argv[optind]);
+        }
+    }
+
+    // Take over the environment, so export and unset can change it
+    if (!env_init(environ))
+    {
+        unix_error("env_init error");
+    }
+
+    // Start the fork server (if selected) while the shell is still small
+    // and before it has any handlers to inherit
+    if (!launch_init())
+    {
+        unix_error("launch_init error");
+    }
+
+    sigemptyset(&job_sigs);
+    sigaddset(&job_sigs, SIGCHLD);
+    sigaddset(&job_sigs, SIGINT);
+    sigaddset(&job_sigs, SIGTSTP);
+
+    event_input = event_mode && command == NULL;
+    if (event_mode)
+    {
+        // The job signals stay blocked and are read from a signalfd,
+        // along with stdin
+        if (!evloop_init(input_fd, &job_sigs))
+        {
+            unix_error("evloop_init error");
+        }
+    }
+    else
+    {
+        // Install the signal handlers. Each runs with all the job
+        // signals blocked by the kernel, so it needs no mask calls
+        memset(&action, 0, sizeof(action));
+        action.sa_mask = job_sigs;
+        action.sa_flags = SA_RESTART;
+        action.sa_handler = sigint_handler;     // Handles ctrl-c
+        if (sigaction(SIGINT, &action, NULL) < 0)
+        {
+            unix_error("Signal error");
+        }
+        action.sa_handler = sigtstp_handler;    // Handles ctrl-z
+        if (sigaction(SIGTSTP, &action, NULL) < 0)
+        {
+            unix_error("Signal error");
+        }
+
+        // Handles terminated or stopped child
+        action.sa_sigaction = sigchld_handler;
+        action.sa_flags = SA_SIGINFO | SA_RESTART;
+        if (sigaction(SIGCHLD, &action, NULL) < 0)
+        {
+            unix_error("Signal error");
+        }
+    }
 
     Signal(SIGTTIN, SIG_IGN);
     Signal(SIGTTOU, SIG_IGN);
@@ -83,22 +245,48 @@ int main(int argc, char **argv)
     // Initialize the job list
     initjobs(job_list);
 
+    // Make room for a command line and its argv as long as any the
+    // kernel would run
+    argmax = sysconf(_SC_ARG_MAX);
+    if (argmax < _POSIX_ARG_MAX)
+    {
+        argmax = _POSIX_ARG_MAX;
+    }
+    if (argmax > ARGMAX_CAP)
+    {
+        argmax = ARGMAX_CAP;
+    }
+    if (!arena_init(cmd_arena, 2 * (size_t) argmax, 0))
+    {
+        unix_error("arena_init error");
+    }
+
     // Execute the shell's read/eval loop
     while (true)
     {   
-        if (emit_prompt)
+        // Report the jobs that stopped or ended since the last command
+        if (jobring_pending())
         {
-            printf("%s", prompt);
-            fflush(stdout);
+            blockSig();
+            drainjobs();
+            unblockSig();
         }
 
-        if ((fgets(cmdline, MAXLINE_TSH, stdin) == NULL) && ferror(stdin))
+        if (emit_prompt)
         {
-            app_error("fgets error");
+            printf("%s", prompt);
+            fflush(stdout);
         }
 
-        if (feof(stdin))
+        if ((cmdline = readcmdline()) == NULL)
         { 
+            // The -c string ends quietly, with the status of its last
+            // command
+            if (command != NULL)
+            {
+                fflush(stdout);
+                exit(last_status);
+            }
             // End of file (ctrl-d)
             raise(SIGQUIT);
             printf ("\n");
@@ -106,12 +294,18 @@ int main(int argc, char **argv)
             fflush(stderr);
             return 0;
         }
+
+        // ... including while waiting for it
+        if (jobring_pending())
+        {
+            blockSig();
+            drainjobs();
+            unblockSig();
+        }
         
-        // Remove the trailing newline
-        cmdline[strlen(cmdline)-1] = '\0';
-        
-        // Evaluate the command line
+        // Evaluate the command line, then free everything it needed
         eval(cmdline);
+        arena_reset(cmd_arena);
 
         fflush(stdout);
     } 
@@ -138,33 +332,49 @@ void eval(const char *cmdline)
 {
     parseline_return parse_result;     
     struct cmdline_tokens token;
+    size_t len = strlen(cmdline);
     unblockSig();
     
-    // Parse command line
-    parse_result = parseline(cmdline, &token);
+    // Parse command line, unless it was parsed before
+    if(!pcache_get(cmdline, len, &token, &parse_result)) {
+        parse_result = parseline(cmdline, &token);
+        if(parse_result == PARSELINE_FG || parse_result == PARSELINE_BG)
+            pcache_put(cmdline, len, &token, parse_result);
+    }
     
     if (parse_result == PARSELINE_ERROR || parse_result == PARSELINE_EMPTY)
     {
         return;
     }
     
-    if (token.builtin != BUILTIN_NONE && (!token.infile && !token.outfile)) {
-        switch (token.builtin) {
-            case BUILTIN_QUIT:
-                raise(SIGQUIT);
-                break;
-            case BUILTIN_JOBS:
-                blockSig();
-                return listjobs(job_list, 1);
-            case BUILTIN_BG:
-                return bgcommand(&token);
-            case BUILTIN_FG:
-                return fgcommand(&token);
-            default:
-                break;
+    //a command of nothing but assignments sets the variables
+    if (token.nstages == 1 && countassigns(token.argv) == token.argc) {
+        last_status = 0;
+        for(int i = 0; i < token.argc; i++)
+            putvar(token.argv[i]);
+        return;
+    }
+    
+    //a builtin runs in the shell, so it cannot be a pipeline stage.
+    //a stand-in for a utility is only worth it in the foreground
+    if (token.builtin != NULL && token.nstages == 1 &&
+        (!(token.builtin->flags & BUILTIN_UTILITY) ||
+         (parse_result == PARSELINE_FG &&
+          !stdcmd_wantsreal(token.argv, token.infile, token.outfile)))) {
+        if((token.infile != NULL || token.outfile != NULL) &&
+           !(token.builtin->flags & (BUILTIN_REDIR | BUILTIN_OWNREDIR))) {
+            printf("%s: Redirection not supported\n", token.argv[0]);
+            return;
         }
+        return runbuiltin(&token);
     }
     
+    //the last command of a script or -c needs no job control: the shell
+    //can become the command rather than wait for it
+    if (parse_result == PARSELINE_FG && token.nstages == 1 && tail_exec &&
+        input_atend())
+        tailexec(token.argv, token.infile, token.outfile);
+    
     blockSig();
     
     //Add foreground job
@@ -182,16 +392,16 @@ void eval(const char *cmdline)
  *****************/
 
 /* 
- *  reap zombie processes and update job list
+ *  reaps zombie (and stopped) children and queues their wait statuses
+ *  on the job event ring for the main loop to apply. The handler never
+ *  changes the job list or prints
  */
-void sigchld_handler(int sig) 
+void sigchld_handler(int sig, siginfo_t *info, void *context) 
 {    
-    int status;
-    pid_t pid;
+    int olderrno = errno;
     
-    do
-        pid = waitpid(WAIT_ANY, &status, WUNTRACED|WNOHANG);
-    while(!updateJobStatus(pid, status));
+    reapchildren(info != NULL ? info->si_pid : 0);
+    errno = olderrno;
     return;
 }
 
@@ -200,11 +410,11 @@ void sigchld_handler(int sig)
  */
 void sigint_handler(int sig) 
 {   
-    blockSig();
-    pid_t pid = fgpid(job_list);
-    pid_t gpid = __getpgid(pid);
-    if(gpid != getpid()) kill(-gpid, SIGINT);
-    unblockSig();
+    int olderrno = errno;
+    struct job_t *job = fgjob(job_list);
+    if(job != NULL) signaljob(job, SIGINT);
+    else interrupted = 1;
+    errno = olderrno;
     return;
 }
 
@@ -213,34 +423,31 @@ void sigint_handler(int sig)
  */
 void sigtstp_handler(int sig) 
 {
-    blockSig();
-    pid_t pid = fgpid(job_list);
-    pid_t gpid = __getpgid(pid);
-    if(gpid != getpid()) kill(-gpid, SIGTSTP);
-    unblockSig();
+    int olderrno = errno;
+    struct job_t *job = fgjob(job_list);
+    if(job != NULL) signaljob(job, SIGTSTP);
+    errno = olderrno;
     return;
 }
 
 /*
- * blocks SIGCHLD, SIGINT, SIGTSTP signals
+ * blocks SIGCHLD, SIGINT, SIGTSTP signals. The mask is cached, so this
+ * only costs a system call if they were not already blocked. Not for
+ * use in signal handlers, which run with them blocked anyway
  */
 void blockSig() {
-    sigset_t ourmask;
-    sigaddset(&ourmask, SIGCHLD);
-    sigaddset(&ourmask, SIGINT);
-    sigaddset(&ourmask, SIGTSTP);
-    sigprocmask(SIG_BLOCK, &ourmask, NULL);
+    if(event_mode) return;  //they are never unblocked
+    if(sigmask_block(&job_sigs) < 0)
+        unix_error("sigmask_block error");
 }
 
 /*
  * unblocks SIGCHLD, SIGINT, SIGTSTP signals
  */
 void unblockSig() {
-    sigset_t ourmask;
-    sigaddset(&ourmask, SIGCHLD);
-    sigaddset(&ourmask, SIGINT);
-    sigaddset(&ourmask, SIGTSTP);
-    sigprocmask(SIG_UNBLOCK, &ourmask, NULL);
+    if(event_mode) return;
+    if(sigmask_unblock(&job_sigs) < 0)
+        unix_error("sigmask_unblock error");
 }
 
 /*
@@ -248,17 +455,21 @@ void unblockSig() {
  * command line arguments to retreive a job
  */
 struct job_t* getjob(const struct cmdline_tokens *token) {
+    return findjob(token->argv[1]);
+}
+
+/*
+ * retrieves the job a pid or %jid names, or NULL if there is none
+ */
+struct job_t* findjob(const char *id) {
     struct job_t* job;
     int pid;
-    if(token->argv[1][0] == '%') {
-        int size = sizeof(token->argv[1])/ sizeof(token->argv[1][0]);
-        char jid[size]; 
-        memcpy(jid, &token->argv[1][1], size-1);
-        int id = atoi((const char*) jid);
-        job = getjobjid(job_list, id);
+    if(id[0] == '%') {
+        int jid = atoi(&id[1]);
+        job = getjobjid(job_list, jid);
     }
     else {
-        pid = atoi(token->argv[1]);
+        pid = atoi(id);
         job = getjobpid(job_list, pid); 
     }
     
@@ -266,28 +477,473 @@ struct job_t* getjob(const struct cmdline_tokens *token) {
 }
 
 /*
- * updates the job list and job list based on the status of
- * the pid passed in
+ * converts a wait status into an exit status: 128+n for a process
+ * killed or stopped by signal n
  */
-int updateJobStatus(pid_t pid, int status) {
-    if(pid > 0) {
-        blockSig();
-        struct job_t *job = getjobpid(job_list, pid);
-        if(job != NULL) {
-            if (WIFSTOPPED (status)) {
-                printf("Job [%d] (%d) stopped by signal %d\n", job->jid, job->pid, WSTOPSIG(status));
-                job->state = ST;
-            }
-            else if (WIFEXITED (status) || WIFSIGNALED (status)) {
-                if(WIFSIGNALED (status) && WTERMSIG(status) > 0)
-                   printf("Job [%d] (%d) terminated by signal %d\n", job->jid, job->pid, status);
-                deletejob(job_list, pid);
-            }
+int exitcode(int status) {
+    if(WIFEXITED(status))
+        return WEXITSTATUS(status);
+    if(WIFSTOPPED(status))
+        return 128 + WSTOPSIG(status);
+    return 128 + WTERMSIG(status);
+}
+
+/*
+ * tells the wait builtin that a job ended or stopped with the supplied
+ * wait status, if it is waiting for the job. Returns false if it is
+ * not. Signals must be blocked
+ */
+bool jobfinished(struct job_t *job, int status) {
+    if(job->waited) {
+        job->waited = false;
+        waiter.pending--;
+    }
+    else if(!waiter.any || job->state != BG)
+        return false;
+    waiter.ndone++;
+    if(job->jid == waiter.keyjid || (waiter.keyjid == 0 && waiter.ndone == 1))
+        waiter.status = exitcode(status);
+    return true;
+}
+
+/*
+ * keeps the exit status of a background job that ended, for a later
+ * wait, forgetting the oldest one kept if there is no room
+ */
+void rememberjob(const struct job_t *job, int status) {
+    if(ndonejobs == DONE_MAX)
+        memmove(donejobs, donejobs + 1, --ndonejobs * sizeof(donejobs[0]));
+    donejobs[ndonejobs++] = (struct donejob){ job->pid, job->jid,
+                                              exitcode(status) };
+}
+
+/*
+ * takes the kept exit status of the ended job that a pid or %jid names,
+ * the newest if several match. Returns false if there is none
+ */
+bool takedonejob(const char *id, int *status) {
+    bool byjid = id[0] == '%';
+    int n = atoi(byjid ? id + 1 : id);
+    for(int i = ndonejobs - 1; i >= 0; i--) {
+        if((byjid ? donejobs[i].jid : donejobs[i].pid) != n)
+            continue;
+        *status = donejobs[i].status;
+        memmove(donejobs + i, donejobs + i + 1,
+                (--ndonejobs - i) * sizeof(donejobs[0]));
+        return true;
+    }
+    return false;
+}
+
+/*
+ * updates the job list based on the status of the pid passed in, and
+ * writes the notice to print, if any, to buf (at least NOTICE_MAX bytes).
+ * Returns the length of the notice. Async-signal-safe; signals must be
+ * blocked
+ */
+int updateJobStatus(pid_t pid, int status, char *buf) {
+    struct job_t *job = getjobpid(job_list, pid);
+    int len = 0;
+    if(job == NULL)
+        return 0;
+    if (WIFSTOPPED (status)) {
+        //every stage of a pipeline stops, report the job once
+        if(job->state != ST) {
+            len = sio_snprintf(buf, NOTICE_MAX, "Job [%d] (%d) stopped by signal %d\n", job->jid, job->pid, WSTOPSIG(status));
+            jobfinished(job, status);
+        }
+        job->stopsig = WSTOPSIG(status);
+        setjobstate(job_list, job, ST);
+    }
+    else if (WIFEXITED (status) || WIFSIGNALED (status)) {
+        //the job's status is that of its last stage
+        if(pid == job->lastpid)
+            job->status = status;
+        if(jobprocdone(job_list, job, pid) > 0)
             return 0;
+        status = job->status;
+        if(job->state == FG)
+            last_status = exitcode(status);
+        if(!jobfinished(job, status) && job->state != FG)
+            rememberjob(job, status);
+        if(WIFSIGNALED (status) && WTERMSIG(status) > 0)
+           len = sio_snprintf(buf, NOTICE_MAX, "Job [%d] (%d) terminated by signal %d\n", job->jid, job->pid, WTERMSIG(status));
+        deletejob(job_list, pid);
+    }
+    return len;
+}
+
+/*
+ * reaps every child that has changed state and queues its status on the
+ * job event ring; pid, if not 0, is reaped first through its pidfd.
+ * Leaves the rest unreaped when the ring is full. Async-signal-safe;
+ * signals must be blocked
+ */
+void reapchildren(pid_t pid) {
+    int status;
+    if(pid > 0)
+        reapjob(pid);
+    while(!jobring_full() &&
+          (pid = waitpid(WAIT_ANY, &status, WUNTRACED|WNOHANG)) > 0)
+        jobring_push(pid, status);
+}
+
+/*
+ * applies the queued job events to the job list and prints their
+ * notices, one write per batch. Reaps the children the handler had no
+ * room for. Signals must be blocked
+ */
+void drainjobs() {
+    struct job_event ev[JOBRING_SIZE];
+    char buf[JOBRING_SIZE * NOTICE_MAX];
+    int n, len;
+    do {
+        if(jobring_overflowed())
+            reapchildren(0);
+        n = jobring_pop(ev, JOBRING_SIZE);
+        len = 0;
+        for(int i = 0; i < n; i++)
+            len += updateJobStatus(ev[i].pid, ev[i].status, buf + len);
+        if(len > 0) {
+            //keep the notices after anything printf already buffered
+            fflush(stdout);
+            Rio_writen(STDOUT_FILENO, buf, len);
         }
-        unblockSig();
+    } while(n > 0);
+}
+
+/*
+ * converts the siginfo filled in by waitid into a waitpid status
+ */
+int waitstatus(const siginfo_t *info) {
+    switch(info->si_code) {
+        case CLD_EXITED:
+            return W_EXITCODE(info->si_status, 0);
+        case CLD_STOPPED:
+            return W_STOPCODE(info->si_status);
+        case CLD_DUMPED:
+            return W_EXITCODE(0, info->si_status) | WCOREFLAG;
+        default:
+            return W_EXITCODE(0, info->si_status);
     }
-    return -1;
+}
+
+/*
+ * reaps (or collects the stop of) the job whose process raised SIGCHLD
+ * by waiting on its pidfd, which cannot refer to a recycled pid, and
+ * queues the status. Signals must be blocked
+ */
+void reapjob(pid_t pid) {
+    struct job_t *job = getjobpid(job_list, pid);
+    siginfo_t info;
+    //the pidfd refers to the first process; the others are swept up
+    //by waitpid in the handler
+    if(job == NULL || job->pid != pid || job->pidfd < 0 || jobring_full())
+        return;
+    info.si_pid = 0;
+    if(waitid(P_PIDFD, job->pidfd, &info, WEXITED|WSTOPPED|WNOHANG) < 0)
+        return;
+    if(info.si_pid != 0)
+        jobring_push(pid, waitstatus(&info));
+}
+
+/*
+ * sends a signal to the process group of a job, through the job's pidfd
+ * when the kernel supports process group delivery for pidfds
+ */
+void signaljob(const struct job_t *job, int sig) {
+    if(job->pidfd >= 0 &&
+       pidfd_send_signal(job->pidfd, sig, NULL, PIDFD_SIGNAL_PROCESS_GROUP) == 0)
+        return;
+    kill(-job->pgid, sig);
+}
+
+/*
+ * quit builtin: terminates the shell through the SIGQUIT handler
+ */
+void quitcommand(const struct cmdline_tokens *token) {
+    raise(SIGQUIT);
+}
+
+/*
+ * lists the jobs, with -j as JSON lines
+ */
+void jobscommand(const struct cmdline_tokens *token) {
+    blockSig();
+    if(token->argc > 1 && strcmp(token->argv[1], "-j") == 0)
+        listjobs_json(job_list, STDOUT_FILENO);
+    else
+        listjobs(job_list, STDOUT_FILENO);
+    unblockSig();
+}
+
+/*
+ * echo builtin (and /bin/echo): see stdcmd.h
+ */
+void echocommand(const struct cmdline_tokens *token) {
+    last_status = stdcmd_echo(token->argv);
+}
+
+/*
+ * printf builtin
+ */
+void printfcommand(const struct cmdline_tokens *token) {
+    last_status = stdcmd_printf(token->argv);
+}
+
+/*
+ * true builtin
+ */
+void truecommand(const struct cmdline_tokens *token) {
+    last_status = 0;
+}
+
+/*
+ * false builtin
+ */
+void falsecommand(const struct cmdline_tokens *token) {
+    last_status = 1;
+}
+
+/*
+ * test and [ builtins
+ */
+void testcommand(const struct cmdline_tokens *token) {
+    last_status = stdcmd_test(token->argv);
+}
+
+/*
+ * cat builtin (and /bin/cat): see stdcmd.h
+ */
+void catcommand(const struct cmdline_tokens *token) {
+    last_status = stdcmd_cat(token->argv);
+}
+
+/*
+ * export builtin: sets the variables assigned (NAME=value), or with no
+ * arguments lists them all. Every variable is in the environment, so a
+ * bare NAME only has to be a valid name
+ */
+void exportcommand(const struct cmdline_tokens *token) {
+    last_status = 0;
+    if(token->argc == 1) {
+        for(char **var = environ; *var != NULL; var++)
+            printf("%s\n", *var);
+        return;
+    }
+    for(int i = 1; i < token->argc; i++) {
+        char *arg = token->argv[i];
+        if(env_namelen(arg) > 0)
+            putvar(arg);
+        else if(!env_validname(arg)) {
+            printf("export: '%s': not a valid identifier\n", arg);
+            last_status = 1;
+        }
+    }
+}
+
+/*
+ * unset builtin: removes the named variables
+ */
+void unsetcommand(const struct cmdline_tokens *token) {
+    last_status = 0;
+    for(int i = 1; i < token->argc; i++) {
+        char *name = token->argv[i];
+        if(!env_validname(name)) {
+            printf("unset: '%s': not a valid identifier\n", name);
+            last_status = 1;
+            continue;
+        }
+        env_unset(name);
+        if(strcmp(name, "PATH") == 0)
+            path_changed();
+    }
+}
+
+/*
+ * sets a variable from an assignment (NAME=value), telling the path
+ * cache if it is PATH
+ */
+void putvar(const char *assign) {
+    if(!env_put(assign)) {
+        printf("%s: %s\n", assign, strerror(ENOMEM));
+        last_status = 1;
+        return;
+    }
+    if(strncmp(assign, "PATH=", 5) == 0)
+        path_changed();
+}
+
+/*
+ * counts the assignments (NAME=value words) at the start of argv
+ */
+int countassigns(char *const *argv) {
+    int n = 0;
+    while(argv[n] != NULL && env_namelen(argv[n]) > 0)
+        n++;
+    return n;
+}
+
+/*
+ * exec builtin: replaces the shell with the command. With no command,
+ * its redirections apply to the shell from then on
+ */
+void execcommand(const struct cmdline_tokens *token) {
+    int savedin = -1, savedout = -1;
+    fflush(stdout);
+    if(token->infile != NULL &&
+       !swapfd(STDIN_FILENO, token->infile, O_RDONLY, &savedin)) {
+        last_status = 1;
+        return;
+    }
+    if(token->outfile != NULL &&
+       !swapfd(STDOUT_FILENO, token->outfile, O_WRONLY | O_TRUNC | O_CREAT,
+               &savedout)) {
+        restorefd(STDIN_FILENO, savedin);
+        last_status = 1;
+        return;
+    }
+    if(token->argc == 1) {
+        if(savedin >= 0)
+            close(savedin);
+        if(savedout >= 0)
+            close(savedout);
+        last_status = 0;
+        return;
+    }
+    tailexec(token->argv + 1, NULL, NULL);
+}
+
+/*
+ * replaces the shell with the command in argv, redirected to infile and
+ * outfile if they are not NULL. Never returns: if the command cannot be
+ * run, the shell exits with status 127 (not found) or 126, or 1 if a
+ * redirection fails, as it has nothing left to do
+ */
+void tailexec(char **argv, const char *infile, const char *outfile) {
+    struct launch_spec spec;
+    int err, savedin = -1, savedout = -1;
+    //the shell is going away, so its own environment can take them
+    for(; env_namelen(argv[0]) > 0; argv++)
+        putvar(argv[0]);
+    memset(&spec, 0, sizeof(spec));
+    spec.path = path_resolve(argv[0]);
+    if(spec.path == NULL) {
+        printf("%s: Command not found\n", argv[0]);
+        fflush(stdout);
+        exit(127);
+    }
+    //the shell's own stdin and stdout are redirected, so an open error
+    //is not taken for a missing command. The copies swapfd keeps are
+    //closed on exec
+    fflush(stdout);
+    if((infile != NULL &&
+        !swapfd(STDIN_FILENO, infile, O_RDONLY, &savedin)) ||
+       (outfile != NULL &&
+        !swapfd(STDOUT_FILENO, outfile, O_WRONLY | O_TRUNC | O_CREAT,
+                &savedout))) {
+        fflush(stdout);
+        exit(1);
+    }
+    spec.argv = argv;
+    spec.envp = environ;
+    spec.infile = NULL;
+    spec.outfile = NULL;
+    spec.fd_in = spec.fd_out = -1;
+    spec.pgid = -1;
+    err = launch_exec(&spec);
+    //the message goes where the shell's own output went
+    restorefd(STDOUT_FILENO, savedout);
+    printf("%s: %s\n", argv[0], strerror(err));
+    fflush(stdout);
+    exit(err == ENOENT ? 127 : 126);
+}
+
+/*
+ * points fd at file, opened with flags, keeping a copy of what fd was in
+ * *saved. Returns false, having printed why, if file cannot be opened
+ */
+bool swapfd(int fd, const char *file, int flags, int *saved) {
+    int newfd = open(file, flags | O_CLOEXEC,
+                     S_IRUSR | S_IRGRP | S_IWGRP | S_IWUSR);
+    if(newfd < 0) {
+        printf("%s: %s\n", file, strerror(errno));
+        return false;
+    }
+    *saved = fcntl(fd, F_DUPFD_CLOEXEC, 3);
+    dup2(newfd, fd);
+    close(newfd);
+    return true;
+}
+
+/*
+ * points fd back at what swapfd saved, if anything
+ */
+void restorefd(int fd, int saved) {
+    if(saved < 0)
+        return;
+    dup2(saved, fd);
+    close(saved);
+}
+
+/*
+ * runs a builtin in the shell. The < and > redirections of a
+ * BUILTIN_REDIR builtin are applied to the shell's own stdin and stdout
+ * while it runs
+ */
+void runbuiltin(const struct cmdline_tokens *token) {
+    int savedin = -1, savedout = -1;
+    //the stand-ins for utilities write(2) their output directly
+    fflush(stdout);
+    if((token->infile == NULL && token->outfile == NULL) ||
+       !(token->builtin->flags & BUILTIN_REDIR))
+        return token->builtin->handler(token);
+    if((token->infile == NULL ||
+        swapfd(STDIN_FILENO, token->infile, O_RDONLY, &savedin)) &&
+       (token->outfile == NULL ||
+        swapfd(STDOUT_FILENO, token->outfile, O_WRONLY | O_TRUNC | O_CREAT,
+               &savedout))) {
+        token->builtin->handler(token);
+        fflush(stdout);
+    }
+    else if(token->builtin->flags & BUILTIN_UTILITY)
+        last_status = 1;
+    restorefd(STDOUT_FILENO, savedout);
+    restorefd(STDIN_FILENO, savedin);
+}
+
+/*
+ * hash builtin: with no arguments lists the remembered command paths,
+ * -r forgets them all, and names are looked up and remembered
+ */
+void hashcommand(const struct cmdline_tokens *token) {
+    if(token->argc == 1) {
+        fflush(stdout);
+        path_list(STDOUT_FILENO);
+        return;
+    }
+    if(strcmp(token->argv[1], "-r") == 0) {
+        path_clear();
+        return;
+    }
+    for(int i = 1; i < token->argc; i++) {
+        if(!path_remember(token->argv[i]))
+            printf("hash: %s: not found\n", token->argv[i]);
+    }
+}
+
+/*
+ * pcache builtin: reports what the parsed command cache has done, or
+ * with -r empties it and zeroes its counters
+ */
+void pcachecommand(const struct cmdline_tokens *token) {
+    if(token->argc > 1 && strcmp(token->argv[1], "-r") == 0) {
+        pcache_clear();
+        return;
+    }
+    struct pcache_stats st = pcache_getstats();
+    printf("pcache: %lu hits, %lu misses, %lu evictions, %d/%d entries\n",
+           st.hits, st.misses, st.evictions, st.entries, PCACHE_ENTRIES);
 }
 
 /*
@@ -301,14 +957,14 @@ void bgcommand(const struct cmdline_tokens *token) {
     //retrieve job by jid or pid
     blockSig();
     struct job_t *job = getjob(token);
-    unblockSig();
     //if job found then restart job in background
     if(job != NULL) {
-        kill(job->pid, SIGCONT);
-        job->state = BG;
+        signaljob(job, SIGCONT);
+        setjobstate(job_list, job, BG);
         printf("[%d] (%d) %s\n", job->jid, job->pid, job->cmdline);
     }
     else sio_puts("No such process found\n");
+    unblockSig();
     return;
 }
 
@@ -324,101 +980,351 @@ void fgcommand(const struct cmdline_tokens *token){
     //retrieve job by jid or pid
     struct job_t *job = getjob(token);
     if(job != NULL) {
-        kill(job->pid, SIGCONT);
-        job->state = FG;
-        unblockSig();
-        sigset_t mask, oldmask;
-        sigaddset(&mask, SIGCHLD);
-        sigaddset(&mask, SIGINT);
-        sigaddset(&mask, SIGTSTP);
-        Sigprocmask(SIG_BLOCK, &mask, &oldmask);
-
-        while(fgpid(job_list) != 0)
-        {
-            sigsuspend(&oldmask);   
-        } 
-        blockSig();
-        deletejob(job_list, job->pid);
+        signaljob(job, SIGCONT);
+        setjobstate(job_list, job, FG);
+        waitfg();
     }
     else sio_puts("No such process found\n");
+    unblockSig();
     return;
 }
 
+/*
+ * wait builtin: waits for background jobs to end or stop. With no
+ * arguments it waits for all of them and returns 0; given pids and
+ * %jobids, for those, returning the status of the last one (127 if it
+ * is unknown). With -n it returns once the first of them, or of all the
+ * background jobs, is done, with its status (127 if there is none).
+ * A job that stops, or was stopped, counts as done, with status 128+n
+ * for stop signal n, and one that ended before the wait with the status
+ * kept for it. Ctrl-c stops the wait with status 130
+ */
+void waitcommand(const struct cmdline_tokens *token) {
+    int first = 1;
+    bool unknown = false;
+    if(token->argc > 1 && strcmp(token->argv[1], "-n") == 0)
+        first = 2;
+    bool waitany = first == 2;
+    bool all = token->argc == first;
+    blockSig();
+    //count from what the job list says now
+    drainjobs();
+    waiter = (struct waiter){ .any = waitany && all };
+    interrupted = 0;
+    //a plain wait reports no status, so the kept ones are not needed;
+    //wait -n takes the oldest one, if there is any
+    if(all && !waitany)
+        ndonejobs = 0;
+    if(all && waitany && ndonejobs > 0) {
+        waiter.ndone = 1;
+        waiter.status = donejobs[0].status;
+        memmove(donejobs, donejobs + 1, --ndonejobs * sizeof(donejobs[0]));
+    }
+    for(int i = first; i < token->argc; i++) {
+        struct job_t *job = findjob(token->argv[i]);
+        int status;
+        unknown = false;
+        if(job == NULL && takedonejob(token->argv[i], &status)) {
+            //it ended before the wait began
+            waiter.keyjid = -1;
+            waiter.ndone++;
+            if(!waitany || waiter.ndone == 1)
+                waiter.status = status;
+            continue;
+        }
+        if(job == NULL) {
+            printf("wait: %s: No such job\n", token->argv[i]);
+            unknown = true;
+            continue;
+        }
+        waiter.keyjid = waitany ? 0 : job->jid;
+        if(job->state == ST) {
+            waiter.ndone++;
+            if(!waitany || waiter.ndone == 1)
+                waiter.status = 128 + job->stopsig;
+        }
+        else if(!job->waited) {
+            job->waited = true;
+            waiter.pending++;
+        }
+    }
+    //sleep until enough jobs are done; each wakeup only applies the
+    //events that came, so it costs O(1) per job done
+    while(!interrupted && !(waitany && waiter.ndone > 0) &&
+          (all ? bgjobs(job_list) > 0 : waiter.pending > 0))
+        waitevent();
+    //forget the jobs that are still running
+    for(int i = first; i < token->argc; i++) {
+        struct job_t *job = findjob(token->argv[i]);
+        if(job != NULL)
+            job->waited = false;
+    }
+    waiter.any = false;
+    if(interrupted)
+        last_status = 130;
+    else if(waitany)
+        last_status = waiter.ndone > 0 ? waiter.status : 127;
+    else if(all)
+        last_status = 0;
+    else
+        last_status = unknown ? 127 : waiter.status;
+    unblockSig();
+}
+
+/*
+ * starts the processes for a job through the launch engine, connecting
+ * the stages of a pipeline with pipes, and adds the job to the job list
+ * in the supplied state. Every stage joins the process group of the
+ * first one. Signals must be blocked.
+ * Returns the new job, or NULL if the job could not be started, with
+ * last_status set to 127 (not found) or 126
+ */
+struct job_t* startjob(const struct cmdline_tokens *token, const char *cmdline,
+                       job_state state) {
+    const char *paths[MAXSTAGES];
+    int nassigns[MAXSTAGES];
+    for(int i = 0; i < token->nstages; i++) {
+        char *const *words = &token->argv[token->stage[i]];
+        nassigns[i] = countassigns(words);
+        char *name = words[nassigns[i]];
+        paths[i] = name != NULL ? path_resolve(name) : NULL;
+        if(paths[i] == NULL) {
+            printf("%s: Command not found\n", name != NULL ? name : words[0]);
+            last_status = 127;
+            return NULL;
+        }
+        //resolving the next stage may clear the path cache, so keep
+        //a copy of the path in the command arena
+        if(i < token->nstages - 1) {
+            size_t len = strlen(paths[i]) + 1;
+            char *copy = arena_alloc(cmd_arena, len);
+            if(copy == NULL) {
+                printf("%s: Argument list too long\n", name);
+                last_status = 126;
+                return NULL;
+            }
+            paths[i] = memcpy(copy, paths[i], len);
+        }
+    }
+
+    struct launch_spec spec;
+    struct job_t *job = NULL;
+    int pidfd = -1;
+    int fd_in = -1;
+    int pipefd[2];
+    for(int i = 0; i < token->nstages; i++) {
+        char *const *words = &token->argv[token->stage[i]];
+        char *const *argv = words + nassigns[i];
+        bool last = (i == token->nstages - 1);
+        spec.path = paths[i];
+        spec.argv = argv;
+        //VAR=val words apply to this stage only, through an overlay on
+        //the shell's environment that is undone once it is launched.
+        //an overlay copied into the arena is freed then too
+        struct arena_mark mark = arena_mark(cmd_arena);
+        spec.envp = environ;
+        if(nassigns[i] > 0 &&
+           (spec.envp = env_overlay(words, nassigns[i], cmd_arena)) == NULL) {
+            printf("%s: Argument list too long\n", argv[0]);
+            last_status = 126;
+            break;
+        }
+        spec.infile = i == 0 ? token->infile : NULL;
+        spec.outfile = last ? token->outfile : NULL;
+        spec.fd_in = fd_in;
+        spec.fd_out = -1;
+        spec.pgid = job != NULL ? job->pgid : 0;
+        pid_t pid = -1;
+        bool piped = last || launch_pipe(pipefd);
+        if(piped) {
+            if(!last)
+                spec.fd_out = pipefd[1];
+            pid = launch(&spec, job == NULL ? &pidfd : NULL);
+        }
+        int err = errno;
+        //whatever happened, the overlay must not outlive the stage
+        if(nassigns[i] > 0) {
+            env_restore();
+            arena_rewind(cmd_arena, mark);
+        }
+        if(!piped) {
+            printf("pipe: %s\n", strerror(err));
+            last_status = 126;
+            break;
+        }
+        if(spec.fd_out >= 0)
+            close(spec.fd_out);
+        if(fd_in >= 0)
+            close(fd_in);
+        fd_in = last ? -1 : pipefd[0];
+        //the launch fails if the exec does, so a job that could not
+        //start never enters the job list
+        if(pid < 0) {
+            if(err == ENOENT && spec.infile != NULL &&
+               access(spec.infile, F_OK) < 0)
+                printf("%s: %s\n", spec.infile, strerror(err));
+            else if(err == ENOENT)
+                printf("%s: Command not found\n", argv[0]);
+            else
+                printf("%s: %s\n", argv[0], strerror(err));
+            last_status = err == ENOENT ? 127 : 126;
+            break;
+        }
+        if(job == NULL) {
+            addjob(job_list, pid, state, cmdline);
+            job = getjobpid(job_list, pid);
+            if(job == NULL) {
+                if(pidfd >= 0)
+                    close(pidfd);
+                //nobody would wait for it: let it go
+                kill(-pid, SIGKILL);
+                break;
+            }
+            job->pidfd = pidfd;
+        }
+        else if(!addjobproc(job_list, job, pid)) {
+            kill(pid, SIGKILL);
+            break;
+        }
+    }
+    if(fd_in >= 0)
+        close(fd_in);
+    return job;
+}
+
 /*
  * Starts a job in the background
  */
 void addbgjob(const struct cmdline_tokens *token, const char *cmdline) {
-    pid_t pid = fork();
-    if(pid == 0) {
-        unblockSig();
-        int st;
-        Setpgid(0,0);
-        //restore default handlers
-        Signal(SIGINT, SIG_DFL);
-        Signal(SIGTSTP, SIG_DFL);
-        Signal(SIGCHLD, SIG_DFL);
-        //handle I/O Redirection
-        if((token->infile != NULL) || (token->outfile != NULL)) {
-            int in = open(token->infile, O_RDONLY);
-            int out = open(token->outfile, O_WRONLY | O_TRUNC | O_CREAT, S_IRUSR | S_IRGRP | S_IWGRP | S_IWUSR);
-            dup2(in, 0);
-            dup2(out, 1);
-            close(in);
-            close(out);
-            st = execvp(token->argv[0], token->argv);
-            _exit(2);
-        }
-        st = execve(token->argv[0], token->argv, environ); 
-        if(st == -1) printf("%s: Command not found\n", token->argv[0]);
-        _exit(2);
-    }
-    else {
-        addjob(job_list, pid, BG, cmdline);
-        struct job_t* job = getjobpid(job_list, pid);
+    struct job_t* job = startjob(token, cmdline, BG);
+    if(job != NULL)
         printf("[%d] (%d) %s\n", job->jid, job->pid, job->cmdline);
-        unblockSig();
-    }
+    unblockSig();
 }
 
 /*
  * Starts a job in the foreground
  */
 void addfgjob(const struct cmdline_tokens *token, const char *cmdline) {
-    pid_t pid = fork();
-    if(pid == 0) {
-        int st;
-        unblockSig();
-        //restore default handlers
-        Signal(SIGINT, SIG_DFL);
-        Signal(SIGTSTP, SIG_DFL);
-        Signal(SIGCHLD, SIG_DFL);
-        Setpgid(0,0);
-        //handle I/O Redirection
-        if((token->infile != NULL) || (token->outfile != NULL)) {
-            int in = open(token->infile, O_RDONLY);
-            int out = open(token->outfile, O_WRONLY | O_TRUNC | O_CREAT, S_IRUSR | S_IRGRP | S_IWGRP | S_IWUSR);
-            dup2(in, 0);
-            dup2(out, 1);
-            close(in);
-            close(out);
-            st = execvp(token->argv[0], token->argv);
-            _exit(2);
-        }
-        st = execve(token->argv[0], token->argv, environ); 
-        if(st == -1) printf("%s: Command not found\n", token->argv[0]);
-        _exit(2);
+    struct job_t* job = startjob(token, cmdline, FG);
+    if(job != NULL)
+        waitfg();
+    unblockSig();
+}
+
+/*
+ * waits until there is no foreground job, applying job events as they
+ * come: from the event loop in event mode, else by sleeping in
+ * sigsuspend. Signals must be blocked
+ */
+void waitfg() {
+    drainjobs();
+    while(fgpid(job_list) != 0)
+        waitevent();
+}
+
+/*
+ * sleeps until a signal arrives and applies the job events it brings:
+ * from the event loop in event mode, else in sigsuspend. Signals must
+ * be blocked
+ */
+void waitevent() {
+    int signo;
+    pid_t pid;
+    if(event_mode) {
+        if(evloop_next(false, NULL, 0, &signo, &pid) == EVLOOP_ERROR)
+            unix_error("evloop_next error");
+        handlesignal(signo, pid);
+        return;
     }
-    else {
-        addjob(job_list, pid, FG, cmdline);
-        unblockSig();
-        sigset_t mask, oldmask;
-        sigaddset(&mask, SIGCHLD);
-        sigaddset(&mask, SIGINT);
-        sigaddset(&mask, SIGTSTP);
-        Sigprocmask(SIG_BLOCK, &mask, &oldmask);
-        while(fgpid(job_list) != 0)
-        {
-            sigsuspend(&oldmask);   
-        } 
+    sigmask_suspend(&job_sigs);
+    drainjobs();
+}
+
+/*
+ * acts on a signal read from the event loop: reaps and applies job
+ * events for SIGCHLD, and forwards SIGINT/SIGTSTP to the foreground job
+ */
+void handlesignal(int sig, pid_t pid) {
+    if(sig == SIGCHLD) {
+        reapchildren(pid);
+        drainjobs();
+        return;
+    }
+    struct job_t *job = fgjob(job_list);
+    if(job != NULL) signaljob(job, sig);
+    else if(sig == SIGINT) interrupted = 1;
+}
+
+/*
+ * reads the next command line (at most size - 1 bytes of it, like fgets)
+ * in event mode, acting on the signals that arrive meanwhile. Returns
+ * false at the end of the input
+ */
+bool readevents(char *cmdline, size_t size) {
+    int signo;
+    pid_t pid;
+    while(true) {
+        switch(evloop_next(true, cmdline, size, &signo, &pid)) {
+            case EVLOOP_SIGNAL:
+                handlesignal(signo, pid);
+                break;
+            case EVLOOP_LINE:
+                return true;
+            case EVLOOP_EOF:
+                return false;
+            default:
+                unix_error("evloop_next error");
+        }
+    }
+}
+
+/*
+ * reads the next command line and removes its newline. The line is left
+ * in the input buffer if it is all there, and is otherwise put together
+ * in the command arena, however long. A line too long for the arena is
+ * read to its end and replaced by an empty one. Returns NULL at the end
+ * of the input
+ */
+char* readcmdline() {
+    size_t cap = MAXLINE_TSH, len = 0;
+    bool toolong = false;
+    char *line;
+    //usually the whole line is buffered, and is used where it lies
+    if(!event_input && (line = input_line()) != NULL)
+        return line;
+    line = arena_alloc(cmd_arena, cap);
+    while(true) {
+        //each read stops at a newline or when the buffer is full
+        bool got = event_input ? readevents(line + len, cap - len)
+                              : input_gets(line + len, cap - len);
+        if(!got) {
+            if(!event_input && input_error())
+                unix_error("read error");
+            if(len == 0 && !toolong)
+                return NULL;
+            break;
+        }
+        len += strlen(line + len);
+        if(len > 0 && line[len-1] == '\n') {
+            line[--len] = '\0';
+            break;
+        }
+        if(len == cap - 1) {
+            if(arena_resize(cmd_arena, line, 2 * cap))
+                cap *= 2;
+            else {
+                toolong = true;
+                len = 0;
+            }
+        }
+    }
+    if(toolong) {
+        printf("Error: command line too long\n");
+        line[0] = '\0';
+        len = 0;
     }
+    //give the unused space back for parseline
+    arena_resize(cmd_arena, line, len + 1);
+    return line;
 }
@@ -3,13 +3,21 @@
  */
 
 #include "tsh_helper.h"
+#include "intern.h"
+#include "tokenize.h"
+#include "arena.h"
+#include <sys/uio.h>
+#include <time.h>
+
+#define JOBS_BUFSIZE    8192    // formatted jobs output gathered per writev
+#define JOBS_IOV        256     // pieces of jobs output per writev
 
 /* Global variables */
 extern char **environ;          // Defined in libc
 char prompt[] = "tsh> ";        // Command line prompt (do not change)
 bool verbose = false;           // If true, prints additional output
-bool check_block = true;        // If true, check that signals are blocked
-int nextjid = 1;                // Next job ID to allocate
+bool check_block = true;        // If true (and DEBUG), check that signals
+                                // are blocked
 char sbuf[MAXLINE_TSH];         // For composing sprintf messages
 
 // Parsing states, used for parseline
@@ -21,7 +29,36 @@ typedef enum parse_state
 } parse_state;
 
 
-struct job_t job_list[MAXJOBS]; // The job list
+struct pid_slot                 // An entry of the pid hash
+{
+    pid_t pid;                  // Process of a job, 0 if the entry is free
+    int slot;                   // Index of its job in jobs
+};
+
+struct job_list                 // The job table
+{
+    struct job_t *jobs;         // Job slots, listed in this order
+    pid_t (*procs)[MAXSTAGES];  // pids of each slot's processes, 0 once
+                                // reaped
+    int nslots;                 // Number of slots (grows by doubling)
+    int njobs;                  // Number of slots in use
+    int nbg;                    // Number of jobs in the BG state
+    uint64_t *slotmap;          // Bitmap of the slots in use
+    int *byjid;                 // Slot of each job ID, -1 if unused
+    int njids;                  // Size of byjid
+    uint64_t *jidmap;           // Bitmap of the job IDs in use
+    int maxjid;                 // Largest job ID in use, 0 if none
+    struct pid_slot *bypid;     // Linear-probing hash of every live pid
+    int npids;                  // Entries used in bypid
+    int pidcap;                 // Size of bypid (power of 2)
+    int fgslot;                 // Slot of the foreground job, -1 if none
+};
+
+static struct job_list jobs;    // The job table
+struct job_list *job_list = &jobs;      // The job list
+
+static struct arena arena;      // The command arena
+struct arena *cmd_arena = &arena;       // Holds the current command
 
 /* 
  * parseline - Parse the command line and build the argv array.
@@ -30,10 +67,15 @@ struct job_t job_list[MAXJOBS]; // The job list
  *
  *                command [arguments...] [< infile] [> oufile] [&]
  *
+ *             or a pipeline of such commands separated by '|', where
+ *             only the first may redirect its input and only the last
+ *             its output.
+ *
  *   token:    Pointer to a cmdline_tokens structure. The elements of this
  *             structure will be populated with the parsed tokens. Characters 
  *             enclosed in single or double quotes are treated as a single
- *             argument. 
+ *             argument. Its text and argv are allocated from cmd_arena,
+ *             so they last until the arena is reset.
  *
  * Returns:
  *   PARSELINE_EMPTY:        if the command line is empty
@@ -45,10 +87,20 @@ struct job_t job_list[MAXJOBS]; // The job list
 parseline_return parseline(const char *cmdline, 
                            struct cmdline_tokens *token) 
 {
-    const char delims[] = " \t\r\n";    // argument delimiters (white-space)
-    char *buf;                          // ptr that traverses command line
-    char *next;                         // ptr to the end of the current arg
-    char *endbuf;                       // ptr to end of cmdline string
+    struct tok_span spans[TOK_BATCH];   // a batch of tokens of the line
+    struct tok_span *span;              // the current token
+    int nspans;                         // number of tokens in the batch
+    bool more;                          // the line may have more tokens
+    size_t pos;                         // where the next batch starts
+    size_t errpos;                      // offset of an unmatched quote
+    size_t len;                         // length of the line
+    char *word;                         // the current token, as a string
+    int argcap;                         // size of argv
+    int i;                              // next token of the batch
+
+    int nargs;                          // argv slots used, counting the
+                                        // NULL that ends each stage
+    int last;                           // index of the last stage
 
     parse_state parsing_state;          // indicates if the next token is the
                                         // input or output file
@@ -59,39 +111,69 @@ parseline_return parseline(const char *cmdline,
         return PARSELINE_EMPTY;
     }
 
-    strncpy(token->text, cmdline, MAXLINE_TSH);
-
-    buf = token->text;
-    endbuf = token->text + strlen(token->text);
+    /* Copy the line and start argv in the command arena */
+    len = strlen(cmdline);
+    argcap = ARGV_INIT;
+    if ((token->text = arena_alloc(cmd_arena, len + 1)) == NULL ||
+        (token->argv = arena_alloc(cmd_arena, argcap * sizeof(char *))) == NULL)
+    {
+        fprintf(stderr, "Error: command line too long\n");
+        return PARSELINE_ERROR;
+    }
+    memcpy(token->text, cmdline, len + 1);
 
     // initialize default values
     token->argc = 0;
     token->infile = NULL;
     token->outfile = NULL;
+    token->nstages = 1;
+    token->stage[0] = 0;
+    nargs = 0;
 
-    /* Build the argv list */
+    /* Build the argv list, tokenizing the line a batch at a time */
     parsing_state = ST_NORMAL;
+    pos = 0;
+
+    i = nspans = 0;
+    more = true;
 
-    while (buf < endbuf)
+    while (i < nspans || more)
     {
-        /* Skip the white-spaces */
-        buf += strspn(buf, delims);
-        if (buf >= endbuf) break;
+        if (i == nspans)
+        {
+            nspans = tokenize(token->text, len, &pos, spans, TOK_BATCH,
+                              &errpos);
+            more = (nspans == TOK_BATCH);
+            i = 0;
+            continue;
+        }
+        span = &spans[i++];
 
-        /* Check for I/O redirection specifiers */
-        if (*buf == '<')
+        /* Each token adds at most one slot; keep one for the NULL */
+        if (nargs + 2 > argcap)
         {
-            if (token->infile) // infile already exists
+            argcap *= 2;
+            if (!arena_resize(cmd_arena, token->argv,
+                              argcap * sizeof(char *)))
             {
+                fprintf(stderr, "Error: command line too long\n");
+                return PARSELINE_ERROR;
+            }
+        }
+
+        /* Check for I/O redirection specifiers */
+        if (span->kind == TOK_INFILE)
+        {
+            if (token->infile || token->nstages > 1) // infile already exists
+            {                                        // or not first stage
                 fprintf(stderr, "Error: Ambiguous I/O redirection\n");
                 return PARSELINE_ERROR;
             }
             parsing_state = ST_INFILE;
-            buf++;
             continue;
         }
 
-        else if (*buf == '>')
+        else if (span->kind == TOK_OUTFILE)
         {
             if (token->outfile) // outfile already exists
             {
@@ -99,57 +181,65 @@ parseline_return parseline(const char *cmdline,
                 return PARSELINE_ERROR;
             }
             parsing_state = ST_OUTFILE;
-            buf++;
             continue;
         }
 
-        else if (*buf == '\'' || *buf == '\"')
-        {
-            /* Detect quoted tokens */
-            buf++;
-            next = strchr(buf, *(buf-1));
-        }
-       
-        else
+        else if (span->kind == TOK_PIPE)
         {
-            /* Find next delimiter */
-            next = buf + strcspn(buf, delims);
-        }
-        
-        if (next == NULL)
-        {
-            /* Returned by strchr(); this means that the closing
-               quote was not found. */
-            fprintf (stderr, "Error: unmatched %c.\n", *(buf-1));
-            return PARSELINE_ERROR;
+            if (parsing_state != ST_NORMAL) // | right after < or >
+            {
+                fprintf(stderr, "Error: must provide file name for redirection\n");
+                return PARSELINE_ERROR;
+            }
+            if (nargs == token->stage[token->nstages-1])
+            {
+                fprintf(stderr, "Error: missing command in pipeline\n");
+                return PARSELINE_ERROR;
+            }
+            if (token->outfile) // only the last stage may redirect output
+            {
+                fprintf(stderr, "Error: Ambiguous I/O redirection\n");
+                return PARSELINE_ERROR;
+            }
+            if (token->nstages >= MAXSTAGES)
+            {
+                fprintf(stderr, "Error: pipeline too long\n");
+                return PARSELINE_ERROR;
+            }
+            /* End the current stage */
+            token->argv[nargs++] = NULL;
+            token->stage[token->nstages++] = nargs;
+            continue;
         }
 
-        /* Terminate the token */
-        *next = '\0';
+        /* Terminate the token, over its delimiter or closing quote */
+        word = token->text + span->off;
+        word[span->len] = '\0';
 
         /* Record the token as either the next argument or the i/o file */
         switch (parsing_state)
         {
         case ST_NORMAL:
-            token->argv[token->argc] = buf;
-            token->argc = token->argc+1;
+            token->argv[nargs++] = word;
             break;
         case ST_INFILE:
-            token->infile = buf;
+            token->infile = word;
             break;
         case ST_OUTFILE:
-            token->outfile = buf;
+            token->outfile = word;
             break;
         default:
             fprintf(stderr, "Error: Ambiguous I/O redirection\n");
             return PARSELINE_ERROR;
         }
         parsing_state = ST_NORMAL;
+    }
 
-        /* Check if argv is full */
-        if (token->argc >= MAXARGS-1) break;
-
-        buf = next + 1;
+    if (errpos != TOK_NOERROR)
+    {
+        /* The tokenizer stopped at a quote that is never closed */
+        fprintf (stderr, "Error: unmatched %c.\n", token->text[errpos]);
+        return PARSELINE_ERROR;
     }
 
     if (parsing_state != ST_NORMAL) // buf ends with < or >
@@ -159,39 +249,42 @@ parseline_return parseline(const char *cmdline,
     }
 
     /* The argument list must end with a NULL pointer */
-    token->argv[token->argc] = NULL;
+    token->argv[nargs] = NULL;
+    last = token->nstages-1;
 
-    if (token->argc == 0)                       /* ignore blank line */
+    if (nargs == 0)                             /* ignore blank line */
     {
         return PARSELINE_EMPTY;
     }
-
-    if ((strcmp(token->argv[0], "quit")) == 0)        /* quit command */
-    {
-        token->builtin = BUILTIN_QUIT;
-    }
-    else if ((strcmp(token->argv[0], "jobs")) == 0)   /* jobs command */
+    if (nargs == token->stage[last])            /* line ends with | */
     {
-        token->builtin = BUILTIN_JOBS;
-    }
-    else if ((strcmp(token->argv[0], "bg")) == 0)     /* bg command */
-    {
-        token->builtin = BUILTIN_BG;
-    }
-    else if ((strcmp(token->argv[0], "fg")) == 0)     /* fg command */
-    {
-        token->builtin = BUILTIN_FG;
-    }
-    else
-    {
-        token->builtin = BUILTIN_NONE;
+        fprintf(stderr, "Error: missing command in pipeline\n");
+        return PARSELINE_ERROR;
     }
 
+    /* argc counts the arguments of the first stage */
+    token->argc = (last == 0) ? nargs : token->stage[1]-1;
+
+    token->builtin = builtin_lookup(token->argv[0]);
+
     // Returns 1 if job runs on background; 0 if job runs on foreground
 
-    if (*token->argv[(token->argc)-1] == '&')
+    if (*token->argv[nargs-1] == '&')
     {
-        token->argv[--(token->argc)] = NULL;
+        token->argv[--nargs] = NULL;
+        if (last == 0)
+        {
+            token->argc = nargs;
+        }
+        if (nargs == token->stage[last])        /* nothing but & */
+        {
+            if (last == 0)
+            {
+                return PARSELINE_EMPTY;
+            }
+            fprintf(stderr, "Error: missing command in pipeline\n");
+            return PARSELINE_ERROR;
+        }
         return PARSELINE_BG;
     }
     else
@@ -220,7 +313,11 @@ void sigquit_handler(int sig)
  * Helper routines that manipulate the job list
  **********************************************/
 
-/* check_blocked - Make sure that signals are blocked */
+#ifdef DEBUG
+/*
+ * check_blocked - Make sure that signals are blocked. It asks the kernel
+ * rather than sigmask.h's cache, which is wrong inside signal handlers
+ */
 static void check_blocked()
 {
     if (!check_block)
@@ -237,87 +334,330 @@ static void check_blocked()
         Sio_puts("WARNING: SIGTSTP not blocked\n");
     }
 }
+#else
+#define check_blocked()         // Costs nothing in release builds
+#endif
 
 /* clearjob - Clear the entries in a job struct */
 static void clearjob(struct job_t *job)
 {
+    if (job->pidfd >= 0)
+    {
+        close(job->pidfd);
+    }
     job->pid = 0;
     job->jid = 0;
     job->state = UNDEF;
-    job->cmdline[0] = '\0';
+    job->pgid = 0;
+    job->pidfd = -1;
+    job->nprocs = 0;
+    job->nlive = 0;
+    job->waited = false;
+    job->stopsig = 0;
+    job->status = 0;
+    job->lastpid = 0;
+    job->start.tv_sec = 0;
+    job->start.tv_nsec = 0;
+    if (job->cmdline != NULL)
+    {
+        intern_put(job->cmdline);
+    }
+    job->cmdline = NULL;
 }
 
-/* initjobs - Initialize the job list */
-void initjobs(struct job_t *jl)
+/*
+ * first_clear - Return the first clear bit at or after from in a bitmap
+ * of nbits bits, or -1 if they are all set
+ */
+static int first_clear(const uint64_t *map, int nbits, int from)
 {
-    int i;
+    int i = from / 64;
+    uint64_t word;
 
-    for (i = 0; i < MAXJOBS; i++)
+    if (from >= nbits)
     {
-        clearjob(&jl[i]);
+        return -1;
+    }
+    word = ~map[i] & (~0ULL << (from % 64));
+    for (;;)
+    {
+        if (word != 0)
+        {
+            from = i * 64 + __builtin_ctzll(word);
+            return from < nbits ? from : -1;
+        }
+        if (++i >= (nbits + 63) / 64)
+        {
+            return -1;
+        }
+        word = ~map[i];
     }
 }
 
-/* maxjid - Returns largest allocated job ID */
-static int maxjid(struct job_t *jl) 
+/* grow_bitmap - Resize a bitmap from oldbits to newbits, clearing new bits */
+static uint64_t *grow_bitmap(uint64_t *map, int oldbits, int newbits)
 {
-    check_blocked();
-    int i, max=0;
+    int oldwords = (oldbits + 63) / 64, newwords = (newbits + 63) / 64;
+
+    map = Realloc(map, newwords * sizeof(uint64_t));
+    memset(map + oldwords, 0, (newwords - oldwords) * sizeof(uint64_t));
+    return map;
+}
+
+/* pid_hash - Home bucket of a pid in the pid hash */
+static unsigned pid_hash(const struct job_list *jl, pid_t pid)
+{
+    unsigned h = (unsigned) pid * 2654435761u;
+
+    return (h ^ (h >> 16)) & (jl->pidcap - 1);
+}
+
+/* pid_find - Index of pid in the pid hash, or -1 */
+static int pid_find(const struct job_list *jl, pid_t pid)
+{
+    unsigned i;
 
-    for (i = 0; i < MAXJOBS; i++)
+    for (i = pid_hash(jl, pid); jl->bypid[i].pid != 0;
+         i = (i + 1) & (jl->pidcap - 1))
     {
-        if (jl[i].jid > max)
+        if (jl->bypid[i].pid == pid)
         {
-            max = jl[i].jid;
+            return i;
         }
     }
-    return max;
+    return -1;
 }
 
-/* addjob - Add a job to the job list */
-bool addjob(struct job_t *jl, pid_t pid, job_state state, const char *cmdline) 
+/* pid_insert - Map a pid to a slot; the table must have a free entry */
+static void pid_insert(struct job_list *jl, pid_t pid, int slot)
 {
-    check_blocked();
-    int i;
+    unsigned i = pid_hash(jl, pid);
 
-    if (pid < 1)
+    while (jl->bypid[i].pid != 0 && jl->bypid[i].pid != pid)
     {
-        return false;
+        i = (i + 1) & (jl->pidcap - 1);
+    }
+    if (jl->bypid[i].pid == 0)
+    {
+        jl->npids++;
     }
+    jl->bypid[i].pid = pid;
+    jl->bypid[i].slot = slot;
+}
+
+/* pid_grow - Double the pid hash and rehash its entries */
+static void pid_grow(struct job_list *jl)
+{
+    struct pid_slot *old = jl->bypid;
+    int i, oldcap = jl->pidcap;
 
-    for (i = 0; i < MAXJOBS; i++)
+    jl->pidcap *= 2;
+    jl->bypid = Calloc(jl->pidcap, sizeof(struct pid_slot));
+    jl->npids = 0;
+    for (i = 0; i < oldcap; i++)
     {
-        if (jl[i].pid == 0)
+        if (old[i].pid != 0)
         {
-            jl[i].pid = pid;
-            jl[i].state = state;
-            jl[i].jid = nextjid++;
-            if (nextjid > MAXJOBS)
+            pid_insert(jl, old[i].pid, old[i].slot);
+        }
+    }
+    Free(old);
+}
+
+/*
+ * pid_remove - Remove a pid from the pid hash, shifting back the entries
+ * after it so that no probe sequence is broken
+ */
+static void pid_remove(struct job_list *jl, pid_t pid)
+{
+    unsigned mask = jl->pidcap - 1;
+    int i = pid_find(jl, pid);
+    unsigned j, home;
+
+    if (i < 0)
+    {
+        return;
+    }
+    jl->npids--;
+    for (j = i;;)
+    {
+        jl->bypid[i].pid = 0;
+        for (;;)
+        {
+            j = (j + 1) & mask;
+            if (jl->bypid[j].pid == 0)
             {
-                nextjid = 1;
+                return;
             }
-            strcpy(jl[i].cmdline, cmdline);
-            if(verbose)
+            // Move entry j into the hole unless its home lies in (i, j]
+            home = pid_hash(jl, jl->bypid[j].pid);
+            if (((j - home) & mask) >= ((j - i) & mask))
             {
-                printf("Added job [%d] %d %s\n",
-                       job_list[i].jid,
-                       job_list[i].pid,
-                       job_list[i].cmdline);
+                break;
             }
-            return true;
         }
+        jl->bypid[i] = jl->bypid[j];
+        i = j;
     }
-    printf("Tried to create too many jobs\n");
-    return false;
 }
 
-/* deletejob - Delete a job whose PID=pid from the job list */
-bool deletejob(struct job_t *jl, pid_t pid) 
+/* initjobs - Initialize the job list */
+void initjobs(struct job_list *jl)
 {
-    check_blocked();
     int i;
 
-    if (pid < 1)
+    jl->nslots = INITJOBS;
+    jl->jobs = Malloc(jl->nslots * sizeof(struct job_t));
+    jl->procs = Malloc(jl->nslots * sizeof(*jl->procs));
+    for (i = 0; i < jl->nslots; i++)
+    {
+        jl->jobs[i].pidfd = -1;
+        jl->jobs[i].cmdline = NULL;
+        clearjob(&jl->jobs[i]);
+    }
+    jl->slotmap = grow_bitmap(NULL, 0, jl->nslots);
+    jl->njobs = 0;
+    jl->nbg = 0;
+
+    jl->njids = INITJOBS + 1;
+    jl->byjid = Malloc(jl->njids * sizeof(int));
+    for (i = 0; i < jl->njids; i++)
+    {
+        jl->byjid[i] = -1;
+    }
+    jl->jidmap = grow_bitmap(NULL, 0, jl->njids);
+    jl->jidmap[0] |= 1;         // job ID 0 is never allocated
+    jl->maxjid = 0;
+
+    jl->pidcap = 4 * INITJOBS;
+    jl->bypid = Calloc(jl->pidcap, sizeof(struct pid_slot));
+    jl->npids = 0;
+    jl->fgslot = -1;
+}
+
+/* alloc_slot - Take the first free slot, growing the table if needed */
+static int alloc_slot(struct job_list *jl)
+{
+    int i, slot = first_clear(jl->slotmap, jl->nslots, 0);
+
+    if (slot < 0)
+    {
+        slot = jl->nslots;
+        jl->nslots *= 2;
+        jl->jobs = Realloc(jl->jobs, jl->nslots * sizeof(struct job_t));
+        jl->procs = Realloc(jl->procs, jl->nslots * sizeof(*jl->procs));
+        for (i = slot; i < jl->nslots; i++)
+        {
+            jl->jobs[i].pidfd = -1;
+            jl->jobs[i].cmdline = NULL;
+            clearjob(&jl->jobs[i]);
+        }
+        jl->slotmap = grow_bitmap(jl->slotmap, slot, jl->nslots);
+    }
+    jl->slotmap[slot / 64] |= 1ULL << (slot % 64);
+    return slot;
+}
+
+/*
+ * alloc_jid - Allocate the job ID after the largest one in use or, once
+ * MAXJID is reached, the smallest free one. Returns 0 if none is free.
+ */
+static int alloc_jid(struct job_list *jl, int slot)
+{
+    int i, n, jid = jl->maxjid + 1;
+
+    if (jid > MAXJID)
+    {
+        if ((jid = first_clear(jl->jidmap, jl->njids, 1)) < 0)
+        {
+            return 0;
+        }
+    }
+    if (jid >= jl->njids)
+    {
+        n = jl->njids * 2 > MAXJID + 1 ? MAXJID + 1 : jl->njids * 2;
+        jl->byjid = Realloc(jl->byjid, n * sizeof(int));
+        for (i = jl->njids; i < n; i++)
+        {
+            jl->byjid[i] = -1;
+        }
+        jl->jidmap = grow_bitmap(jl->jidmap, jl->njids, n);
+        jl->njids = n;
+    }
+    jl->byjid[jid] = slot;
+    jl->jidmap[jid / 64] |= 1ULL << (jid % 64);
+    if (jid > jl->maxjid)
+    {
+        jl->maxjid = jid;
+    }
+    return jid;
+}
+
+/* addjob - Add a job to the job list */
+bool addjob(struct job_list *jl, pid_t pid, job_state state,
+            const char *cmdline)
+{
+    check_blocked();
+    struct job_t *job;
+    int slot, jid;
+
+    if (pid < 1 || pid_find(jl, pid) >= 0)
+    {
+        return false;
+    }
+
+    slot = alloc_slot(jl);
+    if ((jid = alloc_jid(jl, slot)) == 0)
+    {
+        jl->slotmap[slot / 64] &= ~(1ULL << (slot % 64));
+        printf("Tried to create too many jobs\n");
+        return false;
+    }
+    if (2 * (jl->npids + 1) > jl->pidcap)
+    {
+        pid_grow(jl);
+    }
+    pid_insert(jl, pid, slot);
+
+    job = &jl->jobs[slot];
+    job->pid = pid;
+    job->jid = jid;
+    job->state = state;
+    job->pgid = pid;
+    job->pidfd = -1;
+    clock_gettime(CLOCK_REALTIME, &job->start);
+    jl->procs[slot][0] = pid;
+    job->lastpid = pid;
+    job->nprocs = 1;
+    job->nlive = 1;
+    job->waited = false;
+    job->stopsig = 0;
+    job->status = 0;
+    job->cmdline = intern_get(cmdline);
+    if (state == FG)
+    {
+        jl->fgslot = slot;
+    }
+    else if (state == BG)
+    {
+        jl->nbg++;
+    }
+    jl->njobs++;
+    if (verbose)
+    {
+        printf("Added job [%d] %d %s\n", job->jid, job->pid, job->cmdline);
+    }
+    return true;
+}
+
+/* deletejob - Delete the job that has process pid from the job list */
+bool deletejob(struct job_list *jl, pid_t pid)
+{
+    check_blocked();
+    struct job_t *job = getjobpid(jl, pid);
+    int i, slot;
+
+    if (job == NULL)
     {
         if (verbose)
         {
@@ -326,44 +666,141 @@ bool deletejob(struct job_t *jl, pid_t pid)
         return false;
     }
 
-    for (i = 0; i < MAXJOBS; i++)
+    slot = job - jl->jobs;
+    for (i = 0; i < job->nprocs; i++)
     {
-        if (jl[i].pid == pid)
+        if (jl->procs[slot][i] != 0)
         {
-            clearjob(&jl[i]);
-            nextjid = maxjid(jl)+1;
-            return true;
+            pid_remove(jl, jl->procs[slot][i]);
         }
     }
-    if (verbose)
+    jl->byjid[job->jid] = -1;
+    jl->jidmap[job->jid / 64] &= ~(1ULL << (job->jid % 64));
+    while (jl->maxjid > 0 && jl->byjid[jl->maxjid] < 0)
+    {
+        jl->maxjid--;
+    }
+    jl->slotmap[slot / 64] &= ~(1ULL << (slot % 64));
+    if (jl->fgslot == slot)
+    {
+        jl->fgslot = -1;
+    }
+    if (job->state == BG)
     {
-        Sio_puts("deletejob: Invalid pid\n");
+        jl->nbg--;
     }
-    return false;
+    clearjob(job);
+    jl->njobs--;
+    return true;
 }
 
-/* fgpid - Return PID of current foreground job, 0 if no such job */
-pid_t fgpid(struct job_t *jl)
+/* addjobproc - Add another process (pipeline stage) to a job */
+bool addjobproc(struct job_list *jl, struct job_t *job, pid_t pid)
+{
+    check_blocked();
+
+    if (pid < 1 || job->nprocs >= MAXSTAGES || pid_find(jl, pid) >= 0)
+    {
+        return false;
+    }
+    if (2 * (jl->npids + 1) > jl->pidcap)
+    {
+        pid_grow(jl);
+    }
+    pid_insert(jl, pid, job - jl->jobs);
+    jl->procs[job - jl->jobs][job->nprocs++] = pid;
+    job->lastpid = pid;
+    job->nlive++;
+    return true;
+}
+
+/*
+ * jobprocdone - Record that one of the job's processes was reaped.
+ * Returns the number of its processes still alive. The pid of the last
+ * one stays mapped, so the caller can pass it to deletejob.
+ */
+int jobprocdone(struct job_list *jl, struct job_t *job, pid_t pid)
 {
     check_blocked();
+    pid_t *procs = jl->procs[job - jl->jobs];
     int i;
 
-    for (i = 0; i < MAXJOBS; i++)
+    for (i = 0; i < job->nprocs; i++)
     {
-        if (jl[i].state == FG)
+        if (procs[i] == pid)
         {
-            return jl[i].pid;
+            if (--job->nlive > 0)
+            {
+                // A reaped pid can be reused at once
+                procs[i] = 0;
+                pid_remove(jl, pid);
+            }
+            break;
         }
     }
-    if (verbose)
+    return job->nlive;
+}
+
+/* setjobstate - Change the state of a job, tracking the foreground job */
+void setjobstate(struct job_list *jl, struct job_t *job, job_state state)
+{
+    check_blocked();
+    int slot = job - jl->jobs;
+
+    jl->nbg += (state == BG) - (job->state == BG);
+    job->state = state;
+    if (state == FG)
+    {
+        jl->fgslot = slot;
+    }
+    else if (jl->fgslot == slot)
+    {
+        jl->fgslot = -1;
+    }
+}
+
+/* bgjobs - Return the number of jobs running in the background */
+int bgjobs(struct job_list *jl)
+{
+    check_blocked();
+
+    return jl->nbg;
+}
+
+/* fgjob - Return the current foreground job, NULL if no such job */
+struct job_t *fgjob(struct job_list *jl)
+{
+    check_blocked();
+
+    if (jl->fgslot < 0)
     {
-        Sio_puts("fgpid: No foreground job found\n");
+        if (verbose)
+        {
+            Sio_puts("fgjob: No foreground job found\n");
+        }
+        return NULL;
+    }
+    return &jl->jobs[jl->fgslot];
+}
+
+/* fgpid - Return PID of current foreground job, 0 if no such job */
+pid_t fgpid(struct job_list *jl)
+{
+    check_blocked();
+
+    if (jl->fgslot < 0)
+    {
+        if (verbose)
+        {
+            Sio_puts("fgpid: No foreground job found\n");
+        }
+        return 0;
     }
-    return 0;
+    return jl->jobs[jl->fgslot].pid;
 }
 
 /* getjobpid  - Find a job (by PID) on the job list */
-struct job_t *getjobpid(struct job_t *jl, pid_t pid)
+struct job_t *getjobpid(struct job_list *jl, pid_t pid)
 {
     check_blocked();
     int i;
@@ -377,12 +814,9 @@ struct job_t *getjobpid(struct job_t *jl, pid_t pid)
         return NULL;
     }
 
-    for (i = 0; i < MAXJOBS; i++)
+    if ((i = pid_find(jl, pid)) >= 0)
     {
-        if (jl[i].pid == pid)
-        {
-            return &jl[i];
-        }
+        return &jl->jobs[jl->bypid[i].slot];
     }
     if (verbose)
     {
@@ -393,10 +827,9 @@ struct job_t *getjobpid(struct job_t *jl, pid_t pid)
 }
 
 /* getjobjid  - Find a job (by JID) on the job list */
-struct job_t *getjobjid(struct job_t *jl, int jid) 
+struct job_t *getjobjid(struct job_list *jl, int jid)
 {
     check_blocked();
-    int i;
 
     if (jid < 1)
     {
@@ -406,13 +839,10 @@ struct job_t *getjobjid(struct job_t *jl, int jid)
         }
         return NULL;
     }
-    
-    for (i = 0; i < MAXJOBS; i++)
+
+    if (jid < jl->njids && jl->byjid[jid] >= 0)
     {
-        if (jl[i].jid == jid)
-        {
-            return &jl[i];
-        }
+        return &jl->jobs[jl->byjid[jid]];
     }
     if (verbose)
     {
@@ -422,12 +852,12 @@ struct job_t *getjobjid(struct job_t *jl, int jid)
 }
 
 /* pid2jid - Map process ID to job ID */
-int pid2jid(struct job_t *jl, pid_t pid) 
+int pid2jid(struct job_list *jl, pid_t pid)
 {
     check_blocked();
-    int i;
+    struct job_t *job = getjobpid(jl, pid);
 
-    if (pid < 1)
+    if (job == NULL)
     {
         if (verbose)
         {
@@ -435,70 +865,214 @@ int pid2jid(struct job_t *jl, pid_t pid)
         }
         return 0;
     }
-    for (i = 0; i < MAXJOBS; i++)
+    return job->jid;
+}
+
+/*
+ * The jobs builtin output is gathered into a buffer and written with
+ * writev: formatted text is copied into the buffer, command lines are
+ * pointed to where they are interned.
+ */
+struct jobs_out
+{
+    int fd;                             // Where the output goes
+    size_t used;                        // Bytes of buf in use
+    int niov;                           // Entries of iov in use
+    struct iovec iov[JOBS_IOV];         // What to write, in order
+    char buf[JOBS_BUFSIZE];             // The formatted text
+};
+
+static struct jobs_out jobs_out;
+
+/* out_flush - Write out what has been gathered */
+static void out_flush(struct jobs_out *o)
+{
+    struct iovec *iov = o->iov;
+    int n = o->niov;
+    ssize_t done;
+
+    while (n > 0)
     {
-        if (jl[i].pid == pid)
+        if ((done = writev(o->fd, iov, n)) < 0)
         {
-            return jl[i].jid;
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            fprintf(stderr, "Error writing to output file\n");
+            exit(EXIT_FAILURE);
+        }
+        // Skip what a short write did write
+        for (; n > 0 && (size_t) done >= iov->iov_len; iov++, n--)
+        {
+            done -= iov->iov_len;
+        }
+        if (n > 0)
+        {
+            iov->iov_base = (char *) iov->iov_base + done;
+            iov->iov_len -= done;
         }
     }
-    if (verbose)
+    o->used = 0;
+    o->niov = 0;
+}
+
+/* out_ref - Add the n bytes at s, which stay put until the flush */
+static void out_ref(struct jobs_out *o, const char *s, size_t n)
+{
+    if (o->niov == JOBS_IOV)
     {
-        Sio_puts("pid2jid: Invalid pid\n");
+        out_flush(o);
+    }
+    o->iov[o->niov].iov_base = (char *) s;
+    o->iov[o->niov].iov_len = n;
+    o->niov++;
+}
+
+/* out_text - Add a copy of the n (at most JOBS_BUFSIZE) bytes at s */
+static void out_text(struct jobs_out *o, const char *s, size_t n)
+{
+    struct iovec *last;
+    char *p;
+
+    if (o->used + n > JOBS_BUFSIZE || o->niov == JOBS_IOV)
+    {
+        out_flush(o);
+    }
+    p = o->buf + o->used;
+    memcpy(p, s, n);
+    o->used += n;
+
+    // Text that follows text already in the buffer needs no entry of its own
+    last = o->niov > 0 ? &o->iov[o->niov - 1] : NULL;
+    if (last != NULL && (char *) last->iov_base + last->iov_len == p)
+    {
+        last->iov_len += n;
+    }
+    else
+    {
+        out_ref(o, p, n);
+    }
+}
+
+/* out_json - Add a string as the body of a JSON string */
+static void out_json(struct jobs_out *o, const char *s)
+{
+    char esc[8];
+    const char *run;
+    unsigned char c;
+
+    for (run = s; ; s++)
+    {
+        c = (unsigned char) *s;
+        if (c >= 0x20 && c != '"' && c != '\\' && c != 0x7f)
+        {
+            continue;
+        }
+        if (s > run)
+        {
+            out_ref(o, run, s - run);
+        }
+        if (c == '\0')
+        {
+            return;
+        }
+        switch (c)
+        {
+        case '"':  strcpy(esc, "\\\""); break;
+        case '\\': strcpy(esc, "\\\\"); break;
+        case '\n': strcpy(esc, "\\n"); break;
+        case '\t': strcpy(esc, "\\t"); break;
+        case '\r': strcpy(esc, "\\r"); break;
+        default:   sprintf(esc, "\\u%04x", c);
+        }
+        out_text(o, esc, strlen(esc));
+        run = s + 1;
     }
-    return 0;
 }
 
 /* listjobs - Print the job list */
-void listjobs(struct job_t *jl, int output_fd) 
+void listjobs(struct job_list *jl, int output_fd) 
 {
     check_blocked();
-    int i;
+    struct jobs_out *o = &jobs_out;
+    struct job_t *job;
+    int i, len;
     char buf[MAXLINE_TSH];
 
-    for (i = 0; i < MAXJOBS; i++)
+    o->fd = output_fd;
+    for (i = 0; i < jl->nslots; i++)
     {
-        memset(buf, '\0', MAXLINE_TSH);
-        if (jl[i].pid != 0)
+        job = &jl->jobs[i];
+        if (job->pid != 0)
         {
-            sprintf(buf, "[%d] (%d) ", jl[i].jid, jl[i].pid);
-            if(write(output_fd, buf, strlen(buf)) < 0)
-            {
-                fprintf(stderr, "Error writing to output file\n");
-                exit(EXIT_FAILURE);
-            }
-            memset(buf, '\0', MAXLINE_TSH);
-            switch (jl[i].state)
+            len = sprintf(buf, "[%d] (%d) ", job->jid, job->pid);
+            switch (job->state)
             {
             case BG:
-                sprintf(buf, "Running    ");
+                len += sprintf(buf + len, "Running    ");
                 break;
             case FG:
-                sprintf(buf, "Foreground ");
+                len += sprintf(buf + len, "Foreground ");
                 break;
             case ST:
-                sprintf(buf, "Stopped    ");
+                len += sprintf(buf + len, "Stopped    ");
                 break;
             default:
-                sprintf(buf, "listjobs: Internal error: job[%d].state=%d ",
-                        i, jl[i].state);
+                len += sprintf(buf + len,
+                               "listjobs: Internal error: job[%d].state=%d ",
+                               i, job->state);
             }
+            out_text(o, buf, len);
+            out_ref(o, job->cmdline, strlen(job->cmdline));
+            out_text(o, "\n", 1);
+        }
+    }
+    out_flush(o);
+}
 
-            if(write(output_fd, buf, strlen(buf)) < 0)
-            {
-                fprintf(stderr, "Error writing to output file\n");
-                exit(EXIT_FAILURE);
-            }
+/* listjobs_json - Print the job list as JSON lines */
+void listjobs_json(struct job_list *jl, int output_fd)
+{
+    check_blocked();
+    struct jobs_out *o = &jobs_out;
+    struct job_t *job;
+    const char *state;
+    int i, len;
+    char buf[MAXLINE_TSH];
 
-            memset(buf, '\0', MAXLINE_TSH);
-            sprintf(buf, "%s\n", jl[i].cmdline);
-            if(write(output_fd, buf, strlen(buf)) < 0)
-            {
-                fprintf(stderr, "Error writing to output file\n");
-                exit(EXIT_FAILURE);
-            }
+    o->fd = output_fd;
+    for (i = 0; i < jl->nslots; i++)
+    {
+        job = &jl->jobs[i];
+        if (job->pid == 0)
+        {
+            continue;
+        }
+        switch (job->state)
+        {
+        case BG:
+            state = "running";
+            break;
+        case FG:
+            state = "foreground";
+            break;
+        case ST:
+            state = "stopped";
+            break;
+        default:
+            state = "undefined";
         }
+        len = sprintf(buf, "{\"jid\":%d,\"pid\":%d,\"pgid\":%d,"
+                      "\"state\":\"%s\",\"start\":%lld.%03ld,\"cmdline\":\"",
+                      job->jid, job->pid, job->pgid, state,
+                      (long long) job->start.tv_sec,
+                      job->start.tv_nsec / 1000000);
+        out_text(o, buf, len);
+        out_json(o, job->cmdline);
+        out_text(o, "\"}\n", 3);
     }
+    out_flush(o);
 }
 /******************************
  * end job list helper routines
@@ -514,9 +1088,14 @@ void listjobs(struct job_t *jl, int output_fd)
  */
 void usage(void) 
 {
-    printf("Usage: shell [-hvp]\n");
+    printf("Usage: shell [-hvpe] [-l backend] [-c command | script]\n");
     printf("   -h   print this message\n");
     printf("   -v   print additional diagnostic information\n");
     printf("   -p   do not emit a command prompt\n");
+    printf("   -e   read signals and input through a signalfd/epoll loop\n");
+    printf("   -l   launch jobs with backend fork (default), vfork, spawn\n");
+    printf("        or server (fork server)\n");
+    printf("   -c   run the commands in this string, with no prompt\n");
+    printf("   script  read the commands from this file, with no prompt\n");
     exit(EXIT_FAILURE);
 }
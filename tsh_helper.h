@@ -15,11 +15,18 @@
 #include <assert.h>
 #include "csapp.h"
 #include <stdbool.h>
-
-#define MAXLINE_TSH     1024    // max line size
-#define MAXARGS         128     // max args on a command line
-#define MAXJOBS         16      // max jobs at any point in time
-#define MAXJID          1<<16   // max job ID
+#include <time.h>
+#include "builtin.h"
+
+#define MAXLINE_TSH     1024    // line buffer size (lines read grow in
+                                // steps of this)
+#define ARGV_INIT       64      // initial argv size (argv grows)
+#define TOK_BATCH       64      // tokens parseline takes at a time
+#define ARGMAX_CAP      (1L << 28)  // largest ARG_MAX used for the
+                                    // command arena
+#define MAXSTAGES       16      // max commands in a pipeline
+#define INITJOBS        16      // initial size of the job table
+#define MAXJID          (1<<16) // max job ID
 
 /* 
  * Job states: FG (foreground), BG (background), ST (stopped),
@@ -50,32 +57,35 @@ typedef enum parseline_return
     PARSELINE_ERROR
 } parseline_return;
 
-// Builtin states for shell to execute
-typedef enum builtin_state
-{
-    BUILTIN_NONE,
-    BUILTIN_QUIT,
-    BUILTIN_JOBS,
-    BUILTIN_BG,
-    BUILTIN_FG
-} builtin_state;
-
 struct job_t                    // The job struct
 {
     pid_t pid;                  // Job PID
     int jid;                    // Job ID [1, 2, ...] defined in tsh_helper.c
     job_state state;            // UNDEF, BG, FG, or ST
-    char cmdline[MAXLINE_TSH];  // Command line
+    pid_t pgid;                 // Process group of the job
+    int pidfd;                  // pidfd of the job's (first) process, or -1
+    int status;                 // Wait status of the last stage, once reaped
+    pid_t lastpid;              // pid of the last stage
+    unsigned char nprocs;       // Number of processes (pipeline stages)
+    unsigned char nlive;        // Processes not yet reaped
+    bool waited;                // The wait builtin is waiting for it
+    unsigned char stopsig;      // Signal that stopped it, while ST
+    struct timespec start;      // When the job was added (CLOCK_REALTIME)
+    const char *cmdline;        // Command line, interned (shared by jobs
+                                // with the same command line)
 };
 
 struct cmdline_tokens
 {
-    char text[MAXLINE_TSH];     // Modified text from command line
-    int argc;                   // Number of arguments
-    char *argv[MAXARGS];        // The arguments list
-    char *infile;               // The input file
-    char *outfile;              // The output file
-    builtin_state builtin;      // Indicates if argv[0] is a builtin command
+    char *text;                 // Modified text from command line
+    int argc;                   // Number of arguments (of the first stage)
+    char **argv;                // The arguments list; each pipeline stage
+                                // ends with a NULL
+    char *infile;               // The input file (of the first stage)
+    char *outfile;              // The output file (of the last stage)
+    const struct builtin *builtin;  // The builtin argv[0] names, or NULL
+    int nstages;                // Number of pipeline stages, 1 if no pipe
+    int stage[MAXSTAGES];       // Index in argv where each stage begins
 
 };
 
@@ -84,8 +94,30 @@ struct cmdline_tokens
 extern char prompt[];           // Command line prompt (do not change)
 extern bool verbose;            // If true, prints additional output
 extern bool check_block;        // If true, check that signals are blocked
+                                // (DEBUG builds only)
 
-extern struct job_t job_list[MAXJOBS];  // The job list
+/*
+ * The job list is a table that grows as needed. Jobs are found by job ID
+ * or by the pid of any of their processes in constant time, through an
+ * index by job ID and a hash of the pids, and the foreground job is
+ * tracked as it changes state. Job pointers stay valid until the next
+ * addjob. The pids of a job's processes are kept apart from the job
+ * records, which hold only what a scan of the table needs.
+ */
+struct job_list;
+extern struct job_list *job_list;       // The job list
+
+/*
+ * The command arena holds the command being evaluated: the line read,
+ * the text and argv of its cmdline_tokens. It is limited by ARG_MAX
+ * rather than by fixed sizes, and is reset after every command.
+ */
+struct arena;
+extern struct arena *cmd_arena;         // The command arena
+
+// Exit status of the last foreground command, or of the last stand-in
+// for a utility (echo, test, ...) run in the shell. Defined in tsh.c
+extern int last_status;
 
 /*
  * parseline takes in the command line and pointer to a token struct.
@@ -107,53 +139,95 @@ void sigquit_handler(int sig);
 /*
  * initjobs initializes the supplied job list.
  */
-void initjobs(struct job_t *jl);
+void initjobs(struct job_list *jl);
 
 /*
  * addjob takes in a job list, a process ID, a job state, and the command line
  * and adds the pid, job ID, state, and cmdline into a job struct in
- * the job list. Returns true on success, and false otherwise.
+ * the job list. The job's process group is its pid and it has no pidfd
+ * until the caller stores one. Returns true on success, and false otherwise.
  * See the job_t struct above for more details.
  */
-bool addjob(struct job_t *jl, pid_t pid, job_state state,
+bool addjob(struct job_list *jl, pid_t pid, job_state state,
             const char *cmdline);
 
 /*
- * deletejob deletes the job with the supplied process ID from the job list.
- * It returns true if successful and false if no job with this pid is found.
+ * addjobproc adds another process, the next stage of a pipeline, to a job.
+ * Returns true on success, and false if the job has MAXSTAGES processes.
+ */
+bool addjobproc(struct job_list *jl, struct job_t *job, pid_t pid);
+
+/*
+ * jobprocdone records that the supplied process of a job has been reaped
+ * and returns the number of the job's processes that are still alive.
+ * When none is, the job is still found by the pid, to delete it.
+ */
+int jobprocdone(struct job_list *jl, struct job_t *job, pid_t pid);
+
+/*
+ * deletejob deletes the job with the supplied process ID from the job list,
+ * closing its pidfd. It returns true if successful and false if no job with
+ * this pid is found.
  */
-bool deletejob(struct job_t *jl, pid_t pid);
+bool deletejob(struct job_list *jl, pid_t pid);
+
+/*
+ * setjobstate changes the state of a job in the supplied job list. Job
+ * states must be changed through it, so the foreground job is known.
+ */
+void setjobstate(struct job_list *jl, struct job_t *job, job_state state);
 
 /*
  * fgpid returns the process ID of the foreground job in the
  * supplied job list.
  */
-pid_t fgpid(struct job_t *jl);
+pid_t fgpid(struct job_list *jl);
+
+/*
+ * bgjobs returns the number of jobs in the BG state in the supplied job
+ * list.
+ */
+int bgjobs(struct job_list *jl);
+
+/*
+ * fgjob returns the foreground job of the supplied job list, or NULL.
+ */
+struct job_t *fgjob(struct job_list *jl);
 
 /*
  * getjobpid takes in a job list and a process ID, and returns either
  * a pointer the job struct with the respective process ID, or
- * NULL if a job with the given process ID does not exist.
+ * NULL if a job with the given process ID does not exist. Any process
+ * of a pipeline job finds the job.
  */
-struct job_t *getjobpid(struct job_t *jl, pid_t pid);
+struct job_t *getjobpid(struct job_list *jl, pid_t pid);
 
 /*
  * getjobjid takes in a job list and a job ID, and returns either
  * a pointer the job struct with the respective job ID, or
  * NULL if a job with the given job ID does not exist.
  */
-struct job_t *getjobjid(struct job_t *jl, int jid);
+struct job_t *getjobjid(struct job_list *jl, int jid);
 
 /*
  * pid2jid converts the supplied process ID into its corresponding
  * job ID in the job list.
  */
-int pid2jid(struct job_t *jl, pid_t pid); 
+int pid2jid(struct job_list *jl, pid_t pid); 
+
+/*
+ * listjobs prints the job list. The whole list is gathered and written
+ * with as few writev calls as it fits in.
+ */
+void listjobs(struct job_list *jl, int output_fd);
 
 /*
- * listjobs prints the job list.
+ * listjobs_json prints the job list as JSON lines, one object per job
+ * with its jid, pid, pgid, state ("running", "foreground" or
+ * "stopped"), start (seconds since the epoch, to the millisecond) and
+ * cmdline. Bytes of the command line outside ASCII are passed through.
  */
-void listjobs(struct job_t *jl, int output_fd);
+void listjobs_json(struct job_list *jl, int output_fd);
 
 /*
  * usage prints the usage of the tiny shell.
@@ -161,7 +235,8 @@ void listjobs(struct job_t *jl, int output_fd);
 void usage(void);
 
 /*
- * blocks SIGCHLD, SIGINT, SIGTSTP signals
+ * blocks SIGCHLD, SIGINT, SIGTSTP signals (a no-op in event mode, where
+ * they are always blocked)
  */
 void blockSig();
 
@@ -176,11 +251,150 @@ void unblockSig();
  */
 struct job_t* getjob(const struct cmdline_tokens *token);
 
+/*
+ * retrieves the job a pid or %jid names, or NULL if there is none
+ */
+struct job_t* findjob(const char *id);
+
+/*
+ * converts a wait status into an exit status (128+n for signal n)
+ */
+int exitcode(int status);
+
+/*
+ * tells the wait builtin that a job ended or stopped with the supplied
+ * wait status. Returns false if wait is not waiting for it. Signals must
+ * be blocked
+ */
+bool jobfinished(struct job_t *job, int status);
+
+/*
+ * keeps the exit status of a background job that ended for a later
+ * wait, which takes it back with takedonejob
+ */
+void rememberjob(const struct job_t *job, int status);
+bool takedonejob(const char *id, int *status);
+
 /*
  * receives a pid and a return status and updates the job status 
- * and job list based on the status of the process
+ * and job list based on the status of the process, writing the notice
+ * to print to buf. Returns its length. Signals must be blocked
+ */
+int updateJobStatus(pid_t pid, int status, char *buf);
+
+/*
+ * reaps the children that changed state and queues their statuses on
+ * the job event ring, pid (if not 0) first. Signals must be blocked
+ */
+void reapchildren(pid_t pid);
+
+/*
+ * applies the queued job events to the job list and prints their
+ * notices in one write per batch. Signals must be blocked
  */
-int updateJobStatus(pid_t pid, int status);
+void drainjobs();
+
+/*
+ * quit builtin: terminates the shell
+ */
+void quitcommand(const struct cmdline_tokens *token);
+
+/*
+ * lists the jobs, with -j as JSON lines
+ */
+void jobscommand(const struct cmdline_tokens *token);
+
+/*
+ * echo, printf, true, false, test (and [) and cat builtins: stand-ins for
+ * the utilities, run in the shell (see stdcmd.h). They set last_status
+ */
+void echocommand(const struct cmdline_tokens *token);
+void printfcommand(const struct cmdline_tokens *token);
+void truecommand(const struct cmdline_tokens *token);
+void falsecommand(const struct cmdline_tokens *token);
+void testcommand(const struct cmdline_tokens *token);
+void catcommand(const struct cmdline_tokens *token);
+
+/*
+ * export builtin: sets the variables assigned (NAME=value), or with no
+ * arguments lists them all
+ */
+void exportcommand(const struct cmdline_tokens *token);
+
+/*
+ * unset builtin: removes the named variables
+ */
+void unsetcommand(const struct cmdline_tokens *token);
+
+/*
+ * sets a variable from an assignment (NAME=value), telling the path
+ * cache if it is PATH
+ */
+void putvar(const char *assign);
+
+/*
+ * counts the assignments (NAME=value words) at the start of argv
+ */
+int countassigns(char *const *argv);
+
+/*
+ * exec builtin: replaces the shell with the command. With no command,
+ * its redirections apply to the shell from then on
+ */
+void execcommand(const struct cmdline_tokens *token);
+
+/*
+ * replaces the shell with the command in argv, redirected to infile and
+ * outfile if they are not NULL. Never returns: exits with status 127 or
+ * 126 if the command cannot be run
+ */
+void tailexec(char **argv, const char *infile, const char *outfile);
+
+/*
+ * points fd at file, opened with flags, keeping a copy of what fd was in
+ * *saved. Returns false, having printed why, if file cannot be opened
+ */
+bool swapfd(int fd, const char *file, int flags, int *saved);
+
+/*
+ * points fd back at what swapfd saved, if anything
+ */
+void restorefd(int fd, int saved);
+
+/*
+ * runs a builtin in the shell, with its < and > redirections applied
+ * to the shell's stdin and stdout while it runs
+ */
+void runbuiltin(const struct cmdline_tokens *token);
+
+/*
+ * converts the siginfo filled in by waitid into a waitpid status
+ */
+int waitstatus(const siginfo_t *info);
+
+/*
+ * reaps (or collects the stop of) the job whose process raised SIGCHLD
+ * by waiting on its pidfd, and queues the status. Signals must be blocked
+ */
+void reapjob(pid_t pid);
+
+/*
+ * sends a signal to the process group of a job, through the job's pidfd
+ * when the kernel supports process group delivery for pidfds
+ */
+void signaljob(const struct job_t *job, int sig);
+
+/*
+ * hash builtin: with no arguments lists the remembered command paths,
+ * -r forgets them all, and names are looked up and remembered
+ */
+void hashcommand(const struct cmdline_tokens *token);
+
+/*
+ * pcache builtin: reports what the parsed command cache has done, or
+ * with -r empties it and zeroes its counters
+ */
+void pcachecommand(const struct cmdline_tokens *token);
 
 /*
  * restarts a job in the background.  
@@ -192,6 +406,22 @@ void bgcommand(const struct cmdline_tokens *token);
  */ 
 void fgcommand(const struct cmdline_tokens *token);
 
+/*
+ * wait builtin: waits for all background jobs, for the pids and %jobids
+ * named, or with -n for the first of them to end or stop. Sets
+ * last_status to the status of the job waited for
+ */
+void waitcommand(const struct cmdline_tokens *token);
+
+/*
+ * starts the process for a job through the launch engine and adds it
+ * to the job list in the supplied state. Signals must be blocked.
+ * Returns the new job, or NULL if the process could not be started
+ * (last_status is then 127 or 126)
+ */
+struct job_t* startjob(const struct cmdline_tokens *token, const char *cmdline,
+                       job_state state);
+
 /*
  * Starts a job in the background
  */
@@ -202,4 +432,34 @@ void addbgjob(const struct cmdline_tokens *token, const char *cmdline);
  */
 void addfgjob(const struct cmdline_tokens *token, const char *cmdline);
 
+/*
+ * waits until there is no foreground job, applying the job events that
+ * arrive meanwhile. Signals must be blocked
+ */
+void waitfg();
+
+/*
+ * sleeps until a signal arrives and applies the job events it brings.
+ * Signals must be blocked
+ */
+void waitevent();
+
+/*
+ * acts on a signal read from the event loop (tsh -e)
+ */
+void handlesignal(int sig, pid_t pid);
+
+/*
+ * reads the next command line (at most size - 1 bytes of it, like fgets)
+ * in event mode, acting on the signals that arrive meanwhile. Returns
+ * false at the end of the input
+ */
+bool readevents(char *cmdline, size_t size);
+
+/*
+ * reads the next command line, however long, into the command arena
+ * and removes its newline. Returns NULL at the end of the input
+ */
+char* readcmdline();
+
 #endif